@@ -0,0 +1,481 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <array.hpp>
+#include <definitions.hpp>
+#include <eval.hpp>
+#include <interpreter.hpp>
+#include <lexer.hpp>
+#include <optimizer.hpp>
+#include <parser.hpp>
+#include <program.hpp>
+#include <resolver.hpp>
+#include <simd.hpp>
+#include <typecheck.hpp>
+#include <utils.hpp>
+
+// every allocation made by the benchmarked code goes through here, from
+// any thread, parse_all runs on the pool
+static std::atomic<size_t> allocations = 0;
+
+void *operator new(const size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+// kept out of line: once inlined gcc pairs the free() with the new
+// expression and reports a mismatch that is not there
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+constexpr std::string_view sample = R"(// sample used to build the synthetic corpus
+fn add = (int x, int y) -> x + y;
+
+fn fibonacci = (int n) -> int {
+  print("generating the first $n fibonacci numbers\n");
+
+  int b = 0;
+  int a = 1;
+  int c = 0;
+
+  loop n {
+    c = add(a, b);
+    a = b;
+    b = c;
+  }
+  a;
+}
+
+fn scale = (float x) -> float {
+  float r = 0.5 * x + 1.0 / x;
+  r;
+}
+
+string greeting = "hello world";
+int result = fibonacci(40);
+print("the result is $result");
+)";
+
+// names are global, so every copy of this program gets its own, '@' is
+// replaced by the copy's number
+constexpr std::string_view program_sample = R"(fn add@ = (int x, int y) -> x + y;
+fn scale@ = (float x) -> float {
+  float r@ = 0.5 * x + 1.0 / (x + 1.0);
+  r@;
+}
+int acc@ = 0;
+loop 8 {
+  acc@ = add@(acc@, 3) * 2 - 1;
+}
+float s@ = scale@(2.0);
+print("acc@ is $acc@");
+)";
+
+constexpr double min_time = 0.25;
+
+std::string synthetic_corpus(const size_t bytes) {
+  std::string source;
+  source.reserve(bytes + sample.size());
+  while (source.size() < bytes)
+    source += sample;
+  return source;
+}
+
+// every line carries a trailing comment, like generated code often does
+std::string commented_corpus(const size_t bytes) {
+  std::string sample_commented;
+  for (size_t begin = 0; begin < sample.size();) {
+    const size_t end = sample.find('\n', begin);
+    sample_commented += sample.substr(begin, end - begin);
+    sample_commented += " // generated by lang_bench /* not a block */\n";
+    begin = end + 1;
+  }
+  std::string source;
+  source.reserve(bytes + sample_commented.size());
+  while (source.size() < bytes)
+    source += sample_commented;
+  return source;
+}
+
+// a runnable program of about the given size, copies are numbered from first
+std::string synthetic_program(const size_t bytes, size_t first = 0) {
+  std::string source;
+  for (size_t i = first; source.size() < bytes; i++) {
+    const std::string id = std::to_string(i);
+    for (const char c : program_sample) {
+      if (c == '@')
+        source += id;
+      else
+        source += c;
+    }
+  }
+  return source;
+}
+
+// keeps the compiler from dropping or hoisting the benchmarked work
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Result {
+  std::string name;
+  size_t runs = 0;
+  size_t ops = 0;
+  size_t bytes = 0;
+  size_t allocations = 0;
+  double seconds = 0;
+
+  [[nodiscard]] double ns_per_op() const { return seconds * 1e9 / ops; }
+  [[nodiscard]] double allocs_per_op() const {
+    return static_cast<double>(allocations) / ops;
+  }
+  [[nodiscard]] double bytes_per_second() const { return bytes / seconds; }
+};
+
+std::vector<Result> results;
+
+// repeats run until min_time has passed, run returns how many ops it did
+template <typename F>
+void measure(std::string name, const size_t bytes_per_run, F &&run) {
+  Result result{std::move(name)};
+  const size_t allocations_before = allocations;
+  const auto start = std::chrono::steady_clock::now();
+  do {
+    result.ops += run();
+    result.bytes += bytes_per_run;
+    result.runs++;
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  } while (result.seconds < min_time);
+  result.allocations = allocations - allocations_before;
+  results.push_back(std::move(result));
+}
+
+// program output goes to /dev/null while it is alive
+struct Quiet {
+  int saved = -1;
+
+  Quiet() {
+    std::fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+  }
+
+  ~Quiet() {
+    State::output->flush();
+    std::fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+  }
+};
+
+void reset_state() {
+  State::vars.clear();
+  State::functions.clear();
+  State::scope_variables.clear();
+  State::unresolved_calls.clear();
+  State::unresolved_globals.clear();
+}
+
+// parses and resolves a program the way lang does, optimizations included
+void compile(lexer::Lexer &l, CompilationUnit &unit) {
+  reset_state();
+  l.current_token = 0;
+  parser::generate_expression(l, unit.root);
+  resolver::resolve(unit.root);
+  typecheck::check(unit.root);
+  optimizer::optimize(unit.root);
+}
+
+void run(const Node *root) {
+  eval(root);
+  State::stack.pop(State::globals);
+  array::heap->clear();
+}
+
+void bench_lexer(const std::string &name, const std::string &source) {
+  measure("lexer/scan " + name, source.size(), [&] {
+    const lexer::Lexer l(utils::Source::from_string(source));
+    return l.count();
+  });
+  const auto shared = utils::Source::from_string(source);
+  measure("lexer/next_token " + name, source.size(), [&] {
+    lexer::Lexer l;
+    l.source = shared;
+    l.file_str = {shared->data(), shared->size()};
+    size_t count = 0;
+    for (auto t = l.next_token(); t.type != lexer::eof; t = l.next_token())
+      count++;
+    return count;
+  });
+}
+
+void bench_parser(const std::string &name, const std::string &source) {
+  lexer::Lexer l(utils::Source::from_string(source));
+  measure("parser/generate_expression " + name, source.size(), [&] {
+    CompilationUnit unit;
+    reset_state();
+    l.current_token = 0;
+    parser::generate_expression(l, unit.root);
+    return size_t{1};
+  });
+}
+
+void bench_expression(const size_t terms) {
+  std::string source = "int v = 1;\nint w = ";
+  for (size_t i = 0; i < terms; i++)
+    source += i == 0 ? "v" : i % 3 == 0 ? " * (v + 2)" : " + v - 1";
+  source += ";\n";
+  lexer::Lexer l(utils::Source::from_string(source));
+  measure("parser/parse_expression " + std::to_string(terms) + " terms",
+          source.size(), [&] {
+            CompilationUnit unit;
+            reset_state();
+            l.current_token = 0;
+            parser::generate_expression(l, unit.root);
+            return terms;
+          });
+}
+
+// a bundle of small files, parsed on one thread and on all of them
+void bench_files(const size_t count) {
+  const auto dir =
+      std::filesystem::temp_directory_path() / "lang_bench_files";
+  std::filesystem::create_directories(dir);
+  std::vector<std::string> filenames;
+  size_t bytes = 0;
+  for (size_t i = 0; i < count; i++) {
+    // names are global across files too, each file numbers its own range
+    const std::string source = synthetic_program(4 << 10, i * 1000);
+    filenames.push_back(dir / ("file" + std::to_string(i) + ".lang"));
+    std::ofstream(filenames.back()) << source;
+    bytes += source.size();
+  }
+
+  std::vector<size_t> thread_counts = {1};
+  if (const size_t threads = std::thread::hardware_concurrency(); threads > 1)
+    thread_counts.push_back(threads);
+  for (const size_t n : thread_counts) {
+    ThreadPool pool(n);
+    measure("program/parse_all " + std::to_string(count) + " files, " +
+                std::to_string(n) + (n == 1 ? " thread" : " threads"),
+            bytes, [&] {
+              std::vector<std::shared_ptr<utils::Source>> sources;
+              for (const auto &filename : filenames)
+                sources.push_back(utils::Source::open(filename));
+              const auto files = program::parse_all(sources, pool);
+              return count;
+            });
+  }
+  std::filesystem::remove_all(dir);
+}
+
+void bench_binop(const std::string &name, const Value x, const Value y,
+                 const BinOpType op) {
+  constexpr size_t ops = 1 << 20;
+  Value operands[2] = {x, y};
+  measure("eval/eval_binop " + name, 0, [&] {
+    for (size_t i = 0; i < ops; i++) {
+      keep(operands);
+      keep(eval_binop(operands[0], operands[1], op));
+    }
+    return ops;
+  });
+}
+
+// the array kernels at every level the cpu has, on 10M elements so the
+// operands do not fit in cache
+void bench_simd() {
+  constexpr size_t n = 10'000'000;
+  std::vector<float> x(n, 1.5f);
+  std::vector<float> y(n, 2.5f);
+  std::vector<float> out(n);
+  for (int l = 0; l <= static_cast<int>(simd::supported()); l++) {
+    const auto level = static_cast<simd::Level>(l);
+    simd::set_level(level);
+    const std::string name = simd::LevelNames[l];
+    measure("simd/" + name + " float[] + float[]", 3 * n * sizeof(float), [&] {
+      simd::binop(BinOpType::PLUS, x.data(), y.data(), out.data(), n);
+      keep(out.data());
+      return n;
+    });
+    measure("simd/" + name + " sum(float[])", n * sizeof(float), [&] {
+      keep(simd::sum(x.data(), n));
+      return n;
+    });
+  }
+  simd::set_level(simd::supported());
+}
+
+void bench_calls() {
+  constexpr size_t calls = 100000;
+  const std::string source =
+      "fn add = (int x, int y) -> x + y;\n"
+      "fn twice = (float v) -> float {\n  float t = v * 2.0;\n  t;\n}\n"
+      "int r = 0;\nfloat f = 0.0;\n"
+      "loop " +
+      std::to_string(calls / 2) +
+      " {\n  r = add(r, 1);\n  f = twice(f);\n}\n";
+  lexer::Lexer l(utils::Source::from_string(source));
+  CompilationUnit unit;
+  compile(l, unit);
+  measure("eval/calls", 0, [&] {
+    run(unit.root);
+    return calls;
+  });
+}
+
+void bench_interpolate() {
+  lexer::Lexer l(utils::Source::from_string(
+      "int n = 42;\nfloat x = 1.5;\nstring s = \"x\";\n"));
+  CompilationUnit unit;
+  compile(l, unit);
+  eval(unit.root);
+
+  const Value str = Value::string("n is $n and x is $x, s is $s\n");
+  std::string line;
+  constexpr size_t ops = 1 << 16;
+  measure("eval/interpolate", 0, [&] {
+    for (size_t i = 0; i < ops; i++) {
+      line.clear();
+      interpolate(line, str);
+      keep(line);
+    }
+    return ops;
+  });
+  State::stack.pop(State::globals);
+}
+
+void bench_program(const std::string &name, const std::string &source) {
+  const Quiet quiet;
+  measure("end_to_end " + name, source.size(), [&] {
+    lexer::Lexer l(utils::Source::from_string(source));
+    CompilationUnit unit;
+    compile(l, unit);
+    run(unit.root);
+    return size_t{1};
+  });
+}
+
+// loaded once and run many times, the way an embedder uses it
+void bench_interpreter(const std::string &name, const std::string &source) {
+  Interpreter interpreter;
+  interpreter.load(source, name);
+  measure("interpreter/run " + name, source.size(), [&] {
+    keep(interpreter.run());
+    return size_t{1};
+  });
+}
+
+std::string read_file(const std::string &filename) {
+  const auto source = utils::Source::open(filename);
+  return {source->data(), source->size()};
+}
+
+void escape(std::string &out, const std::string_view str) {
+  for (const char c : str) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+}
+
+void print_json() {
+  std::string out = "{\"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto &r = results[i];
+    out += i == 0 ? "\n  {\"name\": \"" : ",\n  {\"name\": \"";
+    escape(out, r.name);
+    out += std::format("\", \"runs\": {}, \"ops\": {}, \"ns_per_op\": {:.3f}, "
+                       "\"allocs_per_op\": {:.3f}, \"bytes_per_second\": {:.0f}}}",
+                       r.runs, r.ops, r.ns_per_op(), r.allocs_per_op(),
+                       r.bytes == 0 ? 0.0 : r.bytes_per_second());
+  }
+  out += "\n]}";
+  std::println("{}", out);
+}
+
+void print_text() {
+  for (const auto &r : results) {
+    std::print("{:<44} {:12.1f} ns/op {:10.2f} allocs/op", r.name,
+               r.ns_per_op(), r.allocs_per_op());
+    if (r.bytes != 0)
+      std::print(" {:9.2f} MB/s", r.bytes_per_second() / (1024.0 * 1024.0));
+    std::println("");
+  }
+}
+
+} // namespace
+
+// lang_bench [--json] [file.lang...], files replace the default corpus
+int main(const int argc, char **argv) {
+  bool json = false;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg(argv[i]);
+    if (arg == "--json")
+      json = true;
+    else
+      files.emplace_back(arg);
+  }
+
+  if (!files.empty()) {
+    for (const auto &file : files) {
+      const std::string source = read_file(file);
+      bench_lexer(file, source);
+      bench_parser(file, source);
+      bench_program(file, source);
+    }
+  } else {
+    bench_lexer("synthetic 1MB", synthetic_corpus(1 << 20));
+    bench_lexer("commented 1MB", commented_corpus(1 << 20));
+
+    const std::string program = synthetic_program(64 << 10);
+    bench_parser("synthetic 64KB", program);
+    bench_expression(1000);
+    bench_files(200);
+
+    bench_binop("int + int", 3, 4, BinOpType::PLUS);
+    bench_binop("float * float", 1.5f, 2.5f, BinOpType::MUL);
+    bench_binop("int / float", 3, 2.5f, BinOpType::DIV);
+    bench_binop("string + string", Value::string("a"), Value::string("b"),
+                BinOpType::PLUS);
+    bench_simd();
+    bench_calls();
+    bench_interpolate();
+
+    bench_program("test.lang", read_file(LANG_SOURCE_DIR "/test.lang"));
+    bench_program("sqrt.lang", read_file(LANG_SOURCE_DIR "/sqrt.lang"));
+    bench_program("synthetic 64KB", program);
+    bench_program("synthetic 1MB", synthetic_program(1 << 20));
+    bench_interpreter("test.lang", read_file(LANG_SOURCE_DIR "/test.lang"));
+    bench_interpreter("synthetic 64KB", program);
+  }
+
+  if (json)
+    print_json();
+  else
+    print_text();
+  return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Arena {
+public:
+  explicit Arena(const size_t block_size = 64 * 1024)
+      : block_size(block_size) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() { release(); }
+
+  void *allocate(size_t size, size_t alignment);
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>)
+      finalizers.emplace_back(object,
+                              [](void *o) { static_cast<T *>(o)->~T(); });
+    objects++;
+    return object;
+  }
+
+  template <typename T> T *make_array(const size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    return new (allocate(sizeof(T) * count, alignof(T))) T[count]{};
+  }
+
+  std::string_view copy(std::string_view str);
+
+  void release();
+
+  [[nodiscard]] size_t bytes_used() const { return used; }
+  [[nodiscard]] size_t bytes_reserved() const { return reserved; }
+  [[nodiscard]] size_t object_count() const { return objects; }
+  [[nodiscard]] size_t block_count() const { return blocks.size(); }
+
+private:
+  std::vector<std::unique_ptr<std::byte[]>> blocks;
+  std::vector<std::pair<void *, void (*)(void *)>> finalizers;
+  std::byte *cursor = nullptr;
+  std::byte *limit = nullptr;
+  size_t block_size;
+  size_t used = 0;
+  size_t reserved = 0;
+  size_t objects = 0;
+};
@@ -0,0 +1,157 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <definitions.hpp>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// int[] and float[] values hold a handle to a run of 4 byte elements.
+// Arrays are shared by reference and live in the heap of the running
+// program until its run ends, or until nothing can reach them any more
+// where analyze() proves it. + - * and / apply element by element to two
+// arrays of the same length, or to an array and an int or float on either
+// side, on the kernels in simd.hpp
+namespace array {
+
+constexpr bool is_array(const Type type) {
+  return type == INT_ARRAY || type == FLOAT_ARRAY;
+}
+
+constexpr Type element_type(const Type type) {
+  return type == FLOAT_ARRAY ? FLOAT : type == INT_ARRAY ? INT : UNKNOWN;
+}
+
+constexpr Type of(const Type element) {
+  return element == FLOAT ? FLOAT_ARRAY : INT_ARRAY;
+}
+
+// the type of `x op y` when one side is an array, VOID when there is none
+constexpr Type result_type(const Type x, const Type y, const BinOpType op) {
+  if (!is_array(x) && !is_array(y))
+    return VOID;
+  if (op != BinOpType::PLUS && op != BinOpType::MINUS &&
+      op != BinOpType::MUL && op != BinOpType::DIV)
+    return VOID;
+  const Type a = is_array(x) ? element_type(x) : x;
+  const Type b = is_array(y) ? element_type(y) : y;
+  if ((a != INT && a != FLOAT) || (b != INT && b != FLOAT))
+    return VOID;
+  return a == FLOAT || b == FLOAT ? FLOAT_ARRAY : INT_ARRAY;
+}
+
+struct Array {
+  Type type = VOID;
+  uint32_t size = 0;
+  void *data = nullptr;
+
+  [[nodiscard]] int32_t *ints() const { return static_cast<int32_t *>(data); }
+  [[nodiscard]] float *floats() const { return static_cast<float *>(data); }
+};
+
+// every array a run creates, the elements are freed with the heap or by
+// clear(). Arrays live in chunks that never move, chunk k holds
+// first_chunk << k of them, so at() reads without a lock while other
+// threads create
+class Heap {
+public:
+  Heap() = default;
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+  ~Heap() { clear(); }
+
+  // the elements are left uninitialized
+  Value create(Type type, size_t size);
+
+  // frees an array, its handle is handed out again by create
+  void release(uint32_t handle);
+
+  // arrays created and not yet freed
+  size_t size();
+
+  Array &at(const uint32_t handle) const {
+    const size_t k = std::bit_width(handle / first_chunk + 1) - 1;
+    const size_t begin = first_chunk * ((size_t{1} << k) - 1);
+    return chunks[k][handle - begin];
+  }
+
+  // frees every array, their handles must not be used afterwards
+  void clear();
+
+private:
+  static constexpr size_t first_chunk = 64;
+  std::array<std::unique_ptr<Array[]>, 32> chunks;
+  uint32_t count = 0;
+  std::vector<uint32_t> released;
+  std::mutex mutex;
+};
+
+// lang's, its arrays are freed when the process exits
+extern Heap process_heap;
+
+// the heap of the program running on this thread, parallel loops hand it
+// to their workers
+inline thread_local Heap *heap = &process_heap;
+
+// x must hold an array
+inline const Array &get(const Value &x) { return heap->at(x.handle); }
+
+// a zero filled array
+Value make(Type type, size_t size);
+
+// `int[n]` and `float[n]`
+Value allocate(Type type, const Value &length);
+
+// `[a, b]`, the elements are converted to the array's; an UNKNOWN type is
+// float[] when any element is a float and int[] otherwise
+Value literal(Type type, std::span<const Value> elements);
+
+Value load(const Value &array, const Value &index);
+
+void store(const Value &array, const Value &index, const Value &value);
+
+Value length(const Value &array);
+
+// sum for PLUS, min for LESS_THAN and max for MORE_THAN
+Value reduce(const Value &array, BinOpType op);
+
+// x op y where result_type(x.type, y.type, op) is an array
+Value binop(const Value &x, const Value &y, BinOpType op);
+
+// Node::releases: the array an assignment overwrites, and the temporary
+// left or only operand and right operand of a node
+constexpr uint8_t release_target = 1;
+constexpr uint8_t release_left = 2;
+constexpr uint8_t release_right = 4;
+
+// marks what can be freed before the run ends. A variable owns its arrays
+// when every assignment stores one just made by an operator, `[...]` or
+// `int[n]` and it is only read by operators, indexing, len, the
+// reductions, print and functions that neither keep their argument nor
+// assign the variable, outside of `loop parallel`; such an assignment
+// frees the array it overwrites and such locals are freed when their call
+// returns. Arrays made by one operator and used by another are temporaries
+// the second frees. Runs on the resolved tree, before it is flattened or
+// compiled to bytecode
+void analyze(Node *root);
+
+// frees x if it holds an array
+void release(const Value &x);
+
+inline void release(const uint8_t releases, const Value &x,
+                    const Value &y = {}) {
+  if (releases & release_left)
+    release(x);
+  if (releases & release_right)
+    release(y);
+}
+
+// the arrays owned by the locals of a returning call
+inline void release_locals(const Function &function, const Value *frame) {
+  for (const int slot : function.released_slots)
+    release(frame[slot]);
+}
+
+} // namespace array
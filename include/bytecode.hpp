@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <definitions.hpp>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+enum class OpCode : uint8_t {
+  PUSH_CONST,
+  PUSH_EMPTY,
+  POP,
+  LOAD_GLOBAL,
+  STORE_GLOBAL,
+  LOAD_LOCAL,
+  STORE_LOCAL,
+  BINOP,
+  BINOP_INT,
+  BINOP_FLOAT,
+  TO_FLOAT,
+  CHECK_TYPE,
+  CALL,
+  RETURN,
+  JUMP,
+  LOOP,
+  INCREMENT,
+  EMIT_CONST,
+  EMIT_VALUE,
+  EMIT_STRING,
+  PRINT_LINE,
+  MAKE_ARRAY,
+  ALLOC_ARRAY,
+  LOAD_ELEMENT,
+  STORE_ELEMENT,
+  LENGTH,
+  REDUCE,
+  HALT
+};
+
+const std::string OpCodeNames[] = {
+    "PUSH_CONST", "PUSH_EMPTY", "POP",        "LOAD_GLOBAL", "STORE_GLOBAL",
+    "LOAD_LOCAL", "STORE_LOCAL", "BINOP",     "BINOP_INT",   "BINOP_FLOAT",
+    "TO_FLOAT",   "CHECK_TYPE", "CALL",       "RETURN",
+    "JUMP",       "LOOP",       "INCREMENT",  "EMIT_CONST",  "EMIT_VALUE",
+    "EMIT_STRING", "PRINT_LINE", "MAKE_ARRAY", "ALLOC_ARRAY", "LOAD_ELEMENT",
+    "STORE_ELEMENT", "LENGTH",   "REDUCE",     "HALT"};
+
+struct Instruction {
+  OpCode op;
+  int32_t a = 0;
+  int32_t b = 0;
+};
+
+struct FunctionInfo {
+  std::string name;
+  size_t entry = 0;
+  int arity = 0;
+  int num_locals = 0;
+  Type return_type = INT;
+  std::vector<std::string> locals;
+  const Function *function = nullptr;
+};
+
+struct Program {
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  std::vector<FunctionInfo> functions;
+};
+
+Program compile(const Node *root);
+
+void disassemble(const Program &program);
+
+} // namespace bytecode
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <definitions.hpp>
+#include <memory>
+#include <string>
+#include <utils.hpp>
+#include <vector>
+
+// Compiled programs saved next to their source as .langc files: the
+// resolved, type checked and optimized tree, keyed by a hash of the
+// sources so a stale or foreign cache is never used.
+namespace cache {
+
+// bump whenever the file layout or the compiled tree changes
+constexpr uint32_t version = 3;
+
+// FNV-1a of the sources and the compile options
+uint64_t key(const std::vector<std::shared_ptr<utils::Source>> &sources,
+             bool optimize);
+
+// the cache file of a program, named after its first source: foo.lang
+// caches in foo.langc, and a source that is itself named foo.langc in
+// foo.langc.langc rather than over itself
+std::string path(const std::string &filename);
+
+// a program read back from a cache file, node names point into the mapping
+struct Program {
+  std::shared_ptr<utils::Source> data;
+  CompilationUnit unit;
+};
+
+// nullptr when the file is missing, damaged, of another version or key
+std::unique_ptr<Program> load(const std::string &path, uint64_t key);
+
+// written to a temporary file and renamed, so concurrent runs never see a
+// partial cache; false when it could not be written
+bool save(const std::string &path, uint64_t key, const Node *root);
+
+} // namespace cache
@@ -1,19 +1,18 @@
 #pragma once
-#include <any>
-#include <list>
+#include <algorithm>
+#include <arena.hpp>
+#include <cstdint>
 #include <memory>
+#include <output.hpp>
 #include <print>
 #include <unordered_map>
-
-enum Type : int { INT = 0, FLOAT, STRING, BOOL, CHAR, VOID, UNKNOWN };
-
-const std::string TypeNames[] = {"INT",  "FLOAT", "STRING", "BOOL",
-                                 "CHAR", "VOID",  "UNKNOWN"};
+#include <value.hpp>
+#include <vector>
 
 struct Variable {
   std::string name;
   Type type;
-  std::any value;
+  Value value;
 };
 
 enum class NodeType {
@@ -33,9 +32,30 @@ enum class NodeType {
   PRINT,
   LOOP_DECLARATION,
   LOOP_BODY,
+  // `[a, b]`, or `float[n]` whose length is the condition
+  ARRAY,
+  // `left[right]`
+  INDEX,
+  // `left = right` where left is an INDEX
+  ELEMENT_ASSIGNMENT,
+  // `len(a)`
+  LENGTH,
+  // `sum(a)`, `min(a)` and `max(a)`, told apart by binop_type: PLUS,
+  // LESS_THAN and MORE_THAN
+  REDUCTION,
   NONE
 };
 
+const std::string NodeTypeNames[] = {
+    "ROOT_NODE",     "FUNCTION_DECLARATION", "ASSIGNMENT",
+    "IDENTIFIER",    "FUNCTION_CALL",        "FUNCTION_CALL_PARAM",
+    "FUNCTION_BODY", "VARIABLE_DECLARATION", "VARIABLE_ASSIGNMENT",
+    "RETURN",        "BINOP",                "LITERAL",
+    "EXPRESSION",    "PRINT",                "LOOP_DECLARATION",
+    "LOOP_BODY",     "ARRAY",                "INDEX",
+    "ELEMENT_ASSIGNMENT", "LENGTH",          "REDUCTION",
+    "NONE"};
+
 enum class BinOpType {
   PLUS,
   MINUS,
@@ -55,39 +75,206 @@ enum class BinOpType {
   NOT_EQUALS
 };
 
+const std::string BinOpTypeNames[] = {
+    "PLUS",      "MINUS",     "MUL",         "DIV",
+    "ASSIGNMENT", "EQUALS",   "LESS_THAN",   "MORE_THAN",
+    "MORE_EQUALS", "LESS_EQUAL", "OR",       "AND",
+    "XOR",       "NAND",      "NONE",        "NOT_EQUALS"};
+
+// how a node evaluates once the type checker proved its operand types,
+// NONE keeps the dynamic dispatch on the runtime types
+enum class Specialization : uint8_t {
+  NONE,
+  INT_INT,
+  FLOAT_FLOAT,
+  INT_FLOAT,
+  FLOAT_INT,
+  // stored values: an int promoted to float, or a value of unknown type
+  // checked against value_type
+  TO_FLOAT,
+  CHECKED
+};
+
+const std::string SpecializationNames[] = {
+    "NONE",      "INT_INT",  "FLOAT_FLOAT", "INT_FLOAT",
+    "FLOAT_INT", "TO_FLOAT", "CHECKED"};
+
+struct Node;
+
+namespace memo {
+struct Cache;
+}
+
 struct Function {
   std::string name;
   Type return_type = INT;
-  std::unordered_map<std::string, Type> arguments;
+  std::vector<std::pair<std::string, Type>> arguments;
   bool single_expression = false;
+  int num_slots = 0;
+  std::vector<std::string> slot_names;
+  std::vector<Type> slot_types;
+  const Node *body = nullptr;
+  // call counter and native code of the jit, see jit.hpp; the pages of
+  // the code are unmapped with the last copy of the function
+  mutable uint32_t calls = 0;
+  mutable void (*native)(Value *frame, Value *result) = nullptr;
+  mutable std::shared_ptr<void> code_pages;
+  // results of a memoized function, see memo.hpp
+  mutable memo::Cache *memo = nullptr;
+  // locals whose arrays are freed when a call returns, see array.hpp
+  std::vector<int> released_slots;
+};
+
+struct NodeList {
+  Arena *arena = nullptr;
+  Node **items = nullptr;
+  uint32_t count = 0;
+  uint32_t capacity = 0;
+
+  void push_back(Node *node) {
+    if (count == capacity) {
+      capacity = capacity == 0 ? 4 : capacity * 2;
+      Node **grown = arena->make_array<Node *>(capacity);
+      std::copy_n(items, count, grown);
+      items = grown;
+    }
+    items[count++] = node;
+  }
+
+  Node *&emplace_back() {
+    push_back(nullptr);
+    return items[count - 1];
+  }
+
+  [[nodiscard]] Node *front() const { return items[0]; }
+  [[nodiscard]] Node *back() const { return items[count - 1]; }
+  [[nodiscard]] bool empty() const { return count == 0; }
+  [[nodiscard]] size_t size() const { return count; }
+  [[nodiscard]] Node **begin() const { return items; }
+  [[nodiscard]] Node **end() const { return items + count; }
 };
 
 struct Node {
-  std::shared_ptr<Node> left = nullptr;
-  std::shared_ptr<Node> right = nullptr;
-  std::list<std::shared_ptr<Node>> body;
-  std::shared_ptr<Node> condition = nullptr;
-  std::shared_ptr<Node> parent = nullptr;
-  std::any value = 0;
+  Node *left = nullptr;
+  Node *right = nullptr;
+  NodeList body;
+  Node *condition = nullptr;
+  Node *parent = nullptr;
+  Value value = 0;
   Type value_type = UNKNOWN;
   NodeType type = NodeType::NONE;
   BinOpType binop_type = BinOpType::NONE;
-  std::string name{};
-  Function function;
-  std::any return_value;
+  Specialization specialization = Specialization::NONE;
+  std::string_view name{};
+  // resolved frame location: depth 0 is the global frame, 1 the function's
+  int depth = -1;
+  int slot = -1;
+  Function *function = nullptr;
+  Value return_value;
   bool expression = false;
+  // written as `loop parallel n`, see parallel.hpp
+  bool parallel = false;
+  // arrays freed once the node is done with them, see array.hpp
+  uint8_t releases = 0;
+
+  explicit Node(Arena *arena) { body.arena = arena; }
+
+  [[nodiscard]] Arena &arena() const { return *body.arena; }
 
-  std::shared_ptr<Node> append(const NodeType type) {
-    auto &node = body.emplace_back();
-    node = std::make_shared<Node>();
+  Node *create(const NodeType type) const {
+    auto *node = body.arena->make<Node>(body.arena);
     node->type = type;
     return node;
   }
+
+  Node *append(const NodeType type) {
+    auto *node = create(type);
+    body.push_back(node);
+    return node;
+  }
+
+  void set_name(const std::string_view str) { name = body.arena->copy(str); }
+};
+
+static_assert(std::is_trivially_destructible_v<Node>);
+
+struct CompilationUnit {
+  Arena arena;
+  Node *root;
+
+  CompilationUnit() : root(arena.make<Node>(&arena)) {
+    root->type = NodeType::ROOT_NODE;
+    root->name = "Program";
+    root->function = arena.make<Function>();
+  }
+};
+
+size_t count_nodes(const Node *root);
+
+void dump_ast(const Node *root);
+
+// every thread runs on its own stack, allocated on its first push
+struct CallStack {
+  static constexpr size_t capacity = 1 << 16;
+  Value *slots = nullptr;
+  Value *top = nullptr;
+  Value *limit = nullptr;
+  // the tree and flat engines recurse on the thread's native stack, calls
+  // stop this many bytes short of its end, see guard
+  static constexpr uintptr_t native_reserve = 256 * 1024;
+  uintptr_t native_limit = 0;
+
+  [[noreturn]] static void overflow();
+  void allocate();
+
+  // after the first push, a deep recursion ends in overflow() instead of a
+  // crash
+  void guard() const {
+    if (reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) <
+        native_limit)
+      overflow();
+  }
+
+  Value *push(const size_t count) {
+    if (count > static_cast<size_t>(limit - top)) {
+      if (slots != nullptr || count > capacity)
+        overflow();
+      allocate();
+    }
+    Value *base = top;
+    top += count;
+    return base;
+  }
+
+  void pop(Value *base) { top = base; }
+};
+
+struct NameHash {
+  using is_transparent = void;
+  size_t operator()(const std::string_view str) const {
+    return std::hash<std::string_view>{}(str);
+  }
 };
 
+template <typename T>
+using NameMap = std::unordered_map<std::string, T, NameHash, std::equal_to<>>;
 
 struct State {
-  static std::unordered_map<std::string, std::shared_ptr<Node>> vars;
-  static std::unordered_map<std::string, std::shared_ptr<Node>> functions;
-  static std::unordered_map<std::string, std::shared_ptr<Node>> scope_variables;
+  // the parser's name tables, per thread so files can be parsed in parallel
+  static thread_local NameMap<Node *> vars;
+  static thread_local NameMap<Node *> functions;
+  static thread_local NameMap<Node *> scope_variables;
+  // calls to functions and uses of globals the parser had not seen yet,
+  // see program::link
+  static thread_local std::vector<Node *> unresolved_calls;
+  static thread_local std::vector<Node *> unresolved_globals;
+  // the running program, per thread so parallel loops can use workers
+  static inline thread_local CallStack stack;
+  static inline thread_local Value *globals = nullptr;
+  static inline thread_local Value *frame = nullptr;
+  static inline thread_local const Function *function = nullptr;
+  static inline thread_local const Function *global_scope = nullptr;
+  // where print writes, per thread so every interpreter has its own
+  static Output standard_output;
+  static inline thread_local Output *output = &standard_output;
 };
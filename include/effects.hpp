@@ -0,0 +1,33 @@
+#pragma once
+#include <definitions.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// What running a function can do besides computing its value, shared by
+// the parallel loop checks and memoization. Runs on the resolved tree.
+namespace effects {
+
+struct Analysis {
+  // no prints, no assignments to globals or array elements and only calls
+  // to pure functions; one being checked counts as pure so recursion does
+  // not reject itself, what is found pure meanwhile is only kept once the
+  // outermost check succeeds
+  bool pure(const Function *function);
+
+  bool effect_free(const Node *node);
+
+  // globals read by node, directly or through its calls
+  void globals_read(const Node *node, std::unordered_set<int> &read,
+                    std::unordered_set<const Function *> &seen);
+
+  std::unordered_map<const Function *, bool> known;
+
+private:
+  // depth of nested pure() calls, and the functions found pure within the
+  // outermost one
+  int checking = 0;
+  std::vector<const Function *> assumed;
+};
+
+} // namespace effects
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+// An error in a program, from reading its sources to running it. lang
+// prints "[ERROR] " and the message, flushing what the program printed
+// first, and exits with the status; an Interpreter lets it through load()
+// and run().
+class Error : public std::runtime_error {
+public:
+  explicit Error(const std::string &message, const int status = 1)
+      : std::runtime_error(message), status(status) {}
+
+  // lexing and parsing errors exit with 255, the rest with 1
+  int status;
+};
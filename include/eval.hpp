@@ -1,47 +1,178 @@
 #pragma once
-#include <any>
+#include <array.hpp>
+#include <array>
+#include <cstdint>
 #include <definitions.hpp>
 #include <memory>
+#include <type_traits>
+#include <utility>
 
-bool is_numeric(const std::any &x);
+bool is_numeric(const Value &x);
 
-bool is_string(const std::any &x);
+bool is_string(const Value &x);
 
-bool try_eval(const std::any &x, const std::any &y);
+bool try_eval(const Value &x, const Value &y);
 
-template <typename X, typename Y>
-static std::common_type_t<X, Y> eval_numeric_op(X x, Y y, const BinOpType op) {
-  switch (op) {
-  case BinOpType::PLUS:
+[[noreturn]] void division_by_zero();
+
+template <BinOpType Op, typename X, typename Y>
+constexpr std::common_type_t<X, Y> eval_numeric_op(const X x, const Y y) {
+  if constexpr (Op == BinOpType::PLUS)
     return x + y;
-  case BinOpType::MINUS:
+  else if constexpr (Op == BinOpType::MINUS)
     return x - y;
-  case BinOpType::MUL:
+  else if constexpr (Op == BinOpType::MUL)
     return x * y;
-  case BinOpType::DIV:
+  else if constexpr (Op == BinOpType::DIV) {
+    // the cases idiv traps on: zero is an error, INT_MIN / -1 wraps
+    if constexpr (std::is_integral_v<std::common_type_t<X, Y>>) {
+      if (y == 0)
+        division_by_zero();
+      if constexpr (std::is_signed_v<Y>) {
+        if (y == -1)
+          return static_cast<std::common_type_t<X, Y>>(
+              0u - static_cast<uint32_t>(x));
+      }
+    }
     return x / y;
-  case BinOpType::AND:
+  }
+  else if constexpr (Op == BinOpType::AND)
     return x && y;
-  case BinOpType::EQUALS:
+  else if constexpr (Op == BinOpType::EQUALS)
     return x == y;
-  case BinOpType::LESS_EQUAL:
+  else if constexpr (Op == BinOpType::LESS_THAN)
+    return x < y;
+  else if constexpr (Op == BinOpType::MORE_THAN)
+    return x > y;
+  else if constexpr (Op == BinOpType::LESS_EQUAL)
     return x <= y;
-  case BinOpType::MORE_EQUALS:
+  else if constexpr (Op == BinOpType::MORE_EQUALS)
     return x >= y;
-  case BinOpType::OR:
+  else if constexpr (Op == BinOpType::OR)
     return x || y;
-  case BinOpType::NOT_EQUALS:
+  else if constexpr (Op == BinOpType::XOR)
+    return static_cast<bool>(x) != static_cast<bool>(y);
+  else if constexpr (Op == BinOpType::NOT_EQUALS)
     return x != y;
+  else
+    return 0;
+}
+
+// numeric operand pairs with a rule, the left operand decides: ints take
+// anything numeric, floats no bools, chars only ints and floats. A bool on
+// the left has no rule; the old bool/bool and bool/int cases sat behind an
+// is_numeric(x) check that bools never passed, so they never ran
+constexpr bool has_numeric_op(const Type x, const Type y) {
+  switch (x) {
+  case INT:
+    return y == INT || y == FLOAT || y == CHAR || y == BOOL;
+  case FLOAT:
+    return y == INT || y == FLOAT || y == CHAR;
+  case CHAR:
+    return y == INT || y == FLOAT;
+  default:
+    return false;
+  }
+}
+
+template <Type T> auto payload(const Value &x) {
+  if constexpr (T == INT)
+    return x.i;
+  else if constexpr (T == FLOAT)
+    return x.f;
+  else if constexpr (T == BOOL)
+    return x.b;
+  else
+    return x.c;
+}
+
+using BinOpHandler = Value (*)(const Value &x, const Value &y);
+
+// strings concatenate whatever the operator, arrays work element by
+// element, anything without a rule has no value
+template <Type X, Type Y, BinOpType Op>
+Value eval_binop_as(const Value &x, const Value &y) {
+  if constexpr (X == STRING && Y == STRING)
+    return Value::string(x.str() + y.str());
+  else if constexpr (has_numeric_op(X, Y))
+    return eval_numeric_op<Op>(payload<X>(x), payload<Y>(y));
+  else if constexpr (array::result_type(X, Y, Op) != VOID)
+    return array::binop(x, y, Op);
+  else
+    return {};
+}
+
+constexpr size_t type_count = UNKNOWN + 1;
+constexpr size_t binop_count = static_cast<size_t>(BinOpType::NOT_EQUALS) + 1;
+
+constexpr size_t binop_index(const Type x, const Type y, const BinOpType op) {
+  return (x * type_count + y) * binop_count + static_cast<size_t>(op);
+}
+
+template <size_t... I>
+constexpr std::array<BinOpHandler, sizeof...(I)>
+make_binop_table(std::index_sequence<I...>) {
+  return {&eval_binop_as<static_cast<Type>(I / binop_count / type_count),
+                         static_cast<Type>(I / binop_count % type_count),
+                         static_cast<BinOpType>(I % binop_count)>...};
+}
+
+// every (lhs type, rhs type, operator) handler, generated at compile time
+inline constexpr auto binop_table = make_binop_table(
+    std::make_index_sequence<type_count * type_count * binop_count>{});
+
+inline Value eval_binop(const Value &x, const Value &y, const BinOpType op) {
+  return binop_table[binop_index(x.type, y.type, op)](x, y);
+}
+
+// operand types of the specialized binops, indexed by Specialization
+constexpr Type specialized_lhs[] = {UNKNOWN, INT, FLOAT, INT, FLOAT};
+constexpr Type specialized_rhs[] = {UNKNOWN, INT, FLOAT, FLOAT, INT};
+
+// binop on operands whose types the type checker proved, the handler does
+// not depend on the runtime tags
+inline Value eval_binop(const Value &x, const Value &y, const BinOpType op,
+                        const Specialization specialization) {
+  const auto s = static_cast<size_t>(specialization);
+  if (s == 0 || s >= std::size(specialized_lhs))
+    return eval_binop(x, y, op);
+  const size_t index = binop_index(specialized_lhs[s], specialized_rhs[s], op);
+  return binop_table[index](x, y);
+}
+
+[[noreturn]] void type_mismatch(Type expected, Type got);
+
+// a value about to be stored in a variable or argument of the given type
+inline Value convert(const Value &x, const Specialization specialization,
+                     const Type type) {
+  switch (specialization) {
+  case Specialization::TO_FLOAT:
+    return static_cast<float>(x.i);
+  case Specialization::CHECKED:
+    if (x.type == type)
+      return x;
+    if (x.type == INT && type == FLOAT)
+      return static_cast<float>(x.i);
+    type_mismatch(type, x.type);
   default:
-    break;
+    return x;
   }
-  return 0;
 }
 
-std::any eval_numeric(const std::any &x, const std::any &y, const BinOpType op);
+void print_value(const Value &x);
+
+// splits a print template into Segments, a `$name` ends at a space,
+// backslash, newline or token character, which is kept as text
+std::vector<Segment> split_interpolation(std::string_view literal);
+
+// segments of an interned runtime string, split once per string of the
+// running program, see Strings::segments
+const std::vector<Segment> &interpolation_segments(const Value &str);
+
+void format_value(std::string &out, const Value &x);
 
-std::any eval_binop(const std::any &x, const std::any &y, BinOpType op);
+void interpolate(std::string &out, const Value &str);
 
-void print_any(std::any x);
+void write_line(std::string &line);
 
-std::any eval(const std::shared_ptr<Node> &node);
+Value eval(const Node *node);
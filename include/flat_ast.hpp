@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <definitions.hpp>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// The resolved tree copied into parallel arrays indexed by NodeId, walked
+// by `--engine=flat`. It is built last, after typecheck, the optimizer and
+// the analyses have run on the arena allocated pointer tree: typecheck and
+// the optimizer rewrite nodes in place and drop statements, and the vm,
+// the parallel plans and memoization all read Node pointers, so those
+// passes stay on the tree and flatten() copies what they attached.
+namespace flat {
+
+using NodeId = uint32_t;
+constexpr NodeId none = UINT32_MAX;
+
+struct Ast {
+  std::vector<NodeType> kinds;
+  std::vector<BinOpType> binops;
+  std::vector<Specialization> specializations;
+  std::vector<Type> value_types;
+  std::vector<NodeId> left;
+  std::vector<NodeId> right;
+  std::vector<uint32_t> child_begin;
+  std::vector<uint32_t> child_count;
+  std::vector<Value> values;
+  std::vector<int8_t> depths;
+  std::vector<int32_t> slots;
+  std::vector<uint32_t> functions;
+  std::vector<std::string_view> names;
+  std::vector<uint8_t> releases;
+
+  std::vector<NodeId> child_list;
+  std::vector<Function> function_table;
+  NodeId root = none;
+
+  [[nodiscard]] size_t size() const { return kinds.size(); }
+
+  [[nodiscard]] std::span<const NodeId> children(const NodeId id) const {
+    return {child_list.data() + child_begin[id], child_count[id]};
+  }
+
+  [[nodiscard]] const Function &function(const NodeId id) const {
+    return function_table[functions[id]];
+  }
+};
+
+Ast flatten(const Node *root);
+
+Value eval(const Ast &ast, NodeId id);
+
+void run(const Ast &ast);
+
+void dump(const Ast &ast);
+
+} // namespace flat
@@ -0,0 +1,75 @@
+#pragma once
+#include <array.hpp>
+#include <bytecode.hpp>
+#include <error.hpp>
+#include <flat_ast.hpp>
+#include <memo.hpp>
+#include <memory>
+#include <output.hpp>
+#include <parallel.hpp>
+#include <program.hpp>
+#include <string>
+#include <thread_pool.hpp>
+#include <utils.hpp>
+#include <vector>
+
+// The interpreter as a library: an instance owns one program, its syntax
+// tree, compiled form, loop plans, memo caches, output and threads. The
+// program is loaded once and may run any number of times, every run from
+// fresh globals. Instances share no mutable state, so each thread can keep
+// its own, but one instance is used by one thread at a time. The strings
+// and arrays a run creates are freed when it ends. Errors in a program are
+// thrown as an Error, see error.hpp, and leave the instance usable.
+class Interpreter {
+public:
+  struct Options {
+    // "tree", "vm" or "flat"
+    std::string engine = "tree";
+    bool optimize = true;
+    // threads of the instance's `loop parallel`s, 1 runs them in order
+    size_t threads = 1;
+    // compiles hot functions to native code, see jit.hpp
+    bool jit = false;
+    // counts into the running thread's profile, see profile.hpp, which
+    // every run starts afresh; not on the vm
+    bool profile = false;
+    // caches the results of pure functions, see memo.hpp
+    bool memoize = false;
+    size_t memo_capacity = memo::default_capacity;
+  };
+
+  Interpreter() : Interpreter(Options{}) {}
+  // an Error for an unknown engine or profiling on the vm
+  explicit Interpreter(Options options);
+  Interpreter(const Interpreter &) = delete;
+  Interpreter &operator=(const Interpreter &) = delete;
+
+  // parses, links, checks and compiles the sources as one program,
+  // replacing the one loaded before; after an Error nothing is loaded
+  void load(const std::vector<std::shared_ptr<utils::Source>> &sources);
+  void load(std::string source, std::string name = "<memory>");
+
+  // runs the loaded program, returns what it printed; an Error drops the
+  // output of the failed run
+  std::string run();
+
+private:
+  void compile(const std::vector<std::shared_ptr<utils::Source>> &sources);
+
+  Options options;
+  std::unique_ptr<ThreadPool> pool;
+  std::vector<std::unique_ptr<program::File>> files;
+  std::unique_ptr<CompilationUnit> unit;
+  parallel::Plans plans;
+  memo::Caches caches;
+  bytecode::Program bytecode;
+  flat::Ast ast;
+  // the program's strings, the ones a run adds are released when it ends
+  Strings strings;
+  uint32_t loaded_strings = 0;
+  // a run's arrays, freed when it ends
+  array::Heap arrays;
+  std::string printed;
+  // declared after printed, it flushes into it when destroyed
+  Output output;
+};
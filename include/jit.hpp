@@ -0,0 +1,40 @@
+#pragma once
+#include <definitions.hpp>
+
+namespace jit {
+
+// native code of a function body: frame points at the first argument,
+// laid out like the interpreter's [arguments][locals], result receives the
+// body's value
+using Code = void (*)(Value *frame, Value *result);
+
+// calls before a function is compiled
+constexpr uint32_t threshold = 16;
+
+struct Stats {
+  size_t compiled = 0;
+  size_t rejected = 0;
+  size_t code_bytes = 0;
+};
+
+// per thread, like profile::enabled
+inline thread_local bool enabled = false;
+
+// x86-64 code for bodies made of int and float arithmetic on locals,
+// assignments and loops, nullptr for anything else; the function owns the
+// code's pages
+Code compile(const Function &function);
+
+// counts a call, the function is compiled once it gets hot; returns its
+// native code, or nullptr while it runs in the interpreter
+inline Code enter(const Function &function) {
+  if (function.native != nullptr || function.calls > threshold)
+    return function.native;
+  if (++function.calls == threshold)
+    function.native = compile(function);
+  return function.native;
+}
+
+const Stats &stats();
+
+} // namespace jit
@@ -1,7 +1,14 @@
 #pragma once
 #include <algorithm>
-#include <any>
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utils.hpp>
+#include <value.hpp>
+#include <vector>
 
 namespace lexer {
 enum TokenType : int {
@@ -34,10 +41,12 @@ enum TokenType : int {
   print,
   loop,
   colon,
+  open_bracket,
+  close_bracket,
   none
 };
 
-const std::vector<std::string> tokens = {"",
+constexpr std::array<std::string_view, none + 1> tokens = {"",
                                          "=",
                                          "+",
                                          "-",
@@ -66,6 +75,8 @@ const std::vector<std::string> tokens = {"",
                                          "print",
                                          "loop",
                                          ":",
+                                         "[",
+                                         "]",
                                          ""};
 
 const std::vector<std::string> token_names = {"id",
@@ -97,12 +108,17 @@ const std::vector<std::string> token_names = {"id",
                                               "print",
                                               "loop",
                                               "color",
+                                              "open square bracket",
+                                              "close square bracket",
                                               "none"};
 
+// tokens are views into the lexer's source, literals carry their parsed
+// value and string literals with escapes their unescaped, interned text
 struct Token {
-  std::string str{};
   TokenType type = id;
-  std::any value;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  Value value;
   int line_number = 0;
   int char_number = 0;
 };
@@ -112,24 +128,33 @@ struct Lexer {
   int curr_line = 1;
   int curr_char = 0;
   size_t current_token = 0;
-  std::string file_str{};
+  std::shared_ptr<utils::Source> source;
+  std::string_view file_str{};
   std::vector<Token> parsed_tokens;
+  // inside a string literal, the scanner's only state besides the position
+  bool parsing_string = false;
 
   Lexer() = default;
-  explicit Lexer(std::string &str) : file_str{str} { tokenize(str); }
+  explicit Lexer(std::string &str) { tokenize(str); }
+  explicit Lexer(std::shared_ptr<utils::Source> src) : source{std::move(src)} {
+    scan();
+  }
 
   [[nodiscard]] bool done() const;
-  void remove_comments();
-  static bool any_token(const std::string &str, Token &token);
-
-  static bool is_float(const std::string &str);
-  static bool is_int(const std::string &str);
+  void skip_comment();
+  static bool any_token(std::string_view str, Token &token);
+  static TokenType classify(std::string_view str);
+  static bool is_token_char(char c);
+
+  static bool is_float(std::string_view str);
+  static bool is_int(std::string_view str);
+  [[nodiscard]] std::string_view text(const Token &t) const;
+  [[nodiscard]] std::string_view text() const;
   void print_tokens();
   std::pair<Lexer, Lexer> bisect();
   void advance(size_t x);
   void move(int x);
 
-  Lexer slice(const size_t beg, const size_t end);
   std::optional<size_t> find_next(const TokenType t);
   Token next_token();
 
@@ -144,6 +169,7 @@ struct Lexer {
   Token look_ahead(const size_t x = 1);
 
   void tokenize(std::string &filename);
+  void scan();
 };
 
 } // namespace lexer
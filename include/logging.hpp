@@ -1,14 +1,18 @@
 #pragma once
+#include <error.hpp>
 #include <lexer.hpp>
 
-#include <print>
+#include <format>
 #include <string>
 
 namespace logging {
 
-static void expected_error(const lexer::Token &t, const std::string &expected) {
-  println("[ERROR] {}:{}:{}: expected '{}', got '{}'", "test.lang",
-          t.line_number, t.char_number, expected, t.str);
-  exit(255);
+[[noreturn]] static void expected_error(const lexer::Lexer &l,
+                                        const lexer::Token &t,
+                                        const std::string &expected) {
+  throw Error(std::format("{}:{}:{}: expected '{}', got '{}'",
+                          l.source ? l.source->name() : "", t.line_number,
+                          t.char_number + 1, expected, l.text(t)),
+              255);
 }
 } // namespace logging
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <definitions.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Opt-in memoization of pure functions: functions that do not print or
+// store into globals or arrays and read nothing but their arguments get a
+// cache of results keyed by the argument values. Array arguments and
+// results are shared by reference and can change under the cache, and the
+// handles of arrays and strings are reused once a run ends, so functions
+// taking or returning either are not memoized. Every cache holds at most
+// the capacity it was made with and evicts the least recently used.
+namespace memo {
+
+// results per function when none is given
+constexpr size_t default_capacity = 1024;
+
+// functions with more arguments are not memoized
+constexpr size_t max_arguments = 8;
+
+// the arguments of one call, unused entries are left empty
+using Arguments = std::array<Value, max_arguments>;
+
+inline Arguments arguments(const Function &function, const Value *args) {
+  Arguments key{};
+  std::copy_n(args, function.arguments.size(), key.begin());
+  return key;
+}
+
+struct Hash {
+  size_t operator()(const Arguments &args) const;
+};
+
+// compares the bits, equal for equal ints, floats, bools and chars
+struct Equal {
+  bool operator()(const Arguments &a, const Arguments &b) const;
+};
+
+struct Cache {
+  std::string name;
+  // most recently used first
+  std::list<std::pair<Arguments, Value>> entries;
+  std::unordered_map<Arguments, decltype(entries)::iterator, Hash, Equal>
+      index;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t capacity = default_capacity;
+  // parallel loops call pure functions from several threads
+  std::mutex mutex;
+};
+
+// the caches of one program, they must outlive its runs
+using Caches = std::vector<std::unique_ptr<Cache>>;
+
+// gives every pure function a cache of capacity results; runs on the
+// resolved tree
+Caches analyze(const Node *root, size_t capacity = default_capacity);
+
+// the remembered result of function(args), nullopt on a miss
+std::optional<Value> find(const Function &function, const Arguments &args);
+
+// remembers a result, evicting the least recently used one when full
+void insert(const Function &function, const Arguments &args,
+            const Value &result);
+
+// hits, misses and evictions per function on stderr, capacity as given to
+// analyze
+void report(const Caches &caches, size_t capacity);
+
+} // namespace memo
@@ -0,0 +1,15 @@
+#pragma once
+#include <definitions.hpp>
+
+namespace optimizer {
+
+struct Stats {
+  size_t folded = 0;
+  size_t removed = 0;
+};
+
+// folds literal-only binops and drops statements whose value is discarded
+// and that have no effect, runs on the resolved tree
+Stats optimize(Node *root);
+
+} // namespace optimizer
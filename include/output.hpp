@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Program output, buffered and written to stdout with write(2), or
+// appended to a string once redirected. Flushes when the buffer fills, on
+// destruction and, in line buffered mode, after every line.
+class Output {
+public:
+  static constexpr size_t default_size = 64 * 1024;
+
+  explicit Output(const size_t size = default_size) { configure(size, false); }
+  Output(const Output &) = delete;
+  Output &operator=(const Output &) = delete;
+  ~Output() { flush(); }
+
+  void configure(size_t size, bool line_buffered);
+
+  // flushed output goes to target, nullptr writes to stdout again
+  void redirect(std::string *target);
+
+  void write(std::string_view str);
+  void write_line(std::string_view line);
+  void flush();
+
+  [[nodiscard]] size_t bytes_written() const { return written; }
+  [[nodiscard]] size_t flush_count() const { return flushes; }
+  [[nodiscard]] size_t capacity() const { return size; }
+
+private:
+  void write_out(const char *data, size_t count);
+
+  std::unique_ptr<char[]> buffer;
+  size_t size = 0;
+  size_t used = 0;
+  bool line_buffered = false;
+  std::string *target = nullptr;
+  size_t written = 0;
+  size_t flushes = 0;
+};
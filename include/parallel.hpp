@@ -0,0 +1,58 @@
+#pragma once
+#include <definitions.hpp>
+#include <optional>
+#include <string_view>
+#include <thread_pool.hpp>
+#include <unordered_map>
+#include <vector>
+
+// `loop parallel n` splits its iterations across the program's thread pool,
+// the shared one in lang and an instance's own in an Interpreter, when the
+// tree engine runs it.
+// The iterations must be independent: the body may only assign variables
+// it declares and reductions `x = x + e`, `x = x - e` or `x = x * e`, call
+// functions without side effects, and never print or store into arrays.
+// Every chunk runs on its own copy of the loop's frame, afterwards the
+// variables declared in the body hold the last iteration's values and the
+// partial reductions are combined in order.
+namespace parallel {
+
+struct Reduction {
+  int slot;
+  // subtractions accumulate negated terms and are combined by adding
+  BinOpType op;
+};
+
+struct Plan {
+  // the frame holding the loop's variables, 0 for the globals
+  int depth = 0;
+  // assigned by every iteration, the last chunk's values are kept
+  std::vector<int> privates;
+  std::vector<Reduction> reductions;
+};
+
+using Plans = std::unordered_map<const Node *, Plan>;
+
+// the plans and threads of the program running on this thread, loops run
+// sequentially without them
+struct Context {
+  const Plans *plans = nullptr;
+  ThreadPool *pool = nullptr;
+};
+
+inline thread_local Context context;
+
+// checks every parallel loop, reports the ones whose iterations depend on
+// each other; runs on the resolved tree
+Plans analyze(const Node *root);
+
+// runs a checked loop on the context's pool, nullopt when it has to run
+// sequentially: no plan or pool, a single thread or iteration, or the
+// profiler or the jit switched on
+std::optional<Value> run(const Node *loop, int count);
+
+// only the tree engine splits loops, the others run them in order and say
+// so on stderr
+void warn_sequential(const Plans &plans, std::string_view engine);
+
+} // namespace parallel
@@ -11,10 +11,9 @@ Type get_type(const lexer::Token &t);
 
 Function parse_function_header(lexer::Lexer &l);
 
-void parse_expression(lexer::Lexer &l, const std::shared_ptr<Node> &node);
+void parse_expression(lexer::Lexer &l, Node *node);
 
-std::shared_ptr<Node> create_expression(lexer::Lexer &l,
-                                        const std::shared_ptr<Node> &node);
+Node *create_expression(Node *node);
 
-void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node);
+void generate_expression(lexer::Lexer &l, Node *node);
 } // namespace parser
@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <definitions.hpp>
+
+// Opt-in execution profile of the tree and flat evaluators: evaluations
+// per node type, calls and inclusive/exclusive time per function. Every
+// hook is behind a single check of `enabled`, which is per thread so each
+// Interpreter decides for its own runs.
+namespace profile {
+
+inline thread_local bool enabled = false;
+
+// per thread, like the functions' profiles
+inline thread_local std::array<uint64_t,
+                               static_cast<size_t>(NodeType::NONE) + 1>
+    node_counts{};
+
+inline void count(const NodeType type) {
+  node_counts[static_cast<size_t>(type)]++;
+}
+
+// brackets a function's execution, calls nest like the program's
+void enter(const Function *function);
+void exit();
+
+// enter and exit around a scope, exits too when an Error unwinds it
+class Call {
+public:
+  explicit Call(const Function *function) : counted(enabled) {
+    if (counted)
+      enter(function);
+  }
+  Call(const Call &) = delete;
+  Call &operator=(const Call &) = delete;
+  ~Call() {
+    if (counted)
+      exit();
+  }
+
+private:
+  bool counted;
+};
+
+// forgets the thread's profile, a run starts from an empty one
+void reset();
+
+// sorted report on stderr
+void report();
+
+} // namespace profile
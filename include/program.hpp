@@ -0,0 +1,39 @@
+#pragma once
+#include <definitions.hpp>
+#include <memory>
+#include <string>
+#include <thread_pool.hpp>
+#include <utils.hpp>
+#include <vector>
+
+class Timings;
+
+namespace program {
+
+// a source file parsed on its own, calls to functions and uses of globals
+// it does not declare wait in unresolved_calls and unresolved_globals until
+// link
+struct File {
+  std::string filename;
+  CompilationUnit unit;
+  NameMap<Node *> functions;
+  std::vector<Node *> unresolved_calls;
+  // identifiers read, and assignments to a name the file does not declare
+  std::vector<Node *> unresolved_globals;
+};
+
+// lexes and parses a source on the calling thread, timings may be null
+std::unique_ptr<File> parse(const std::shared_ptr<utils::Source> &source,
+                            Timings *timings, bool dump_tokens);
+
+// parses the sources on the pool's threads, results are in input order
+std::vector<std::unique_ptr<File>>
+parse_all(const std::vector<std::shared_ptr<utils::Source>> &sources,
+          ThreadPool &pool);
+
+// appends the files' top level statements to root in order, fills
+// State::functions with every file's functions and links the calls and
+// globals that were left unresolved
+void link(const std::vector<std::unique_ptr<File>> &files, Node *root);
+
+} // namespace program
@@ -0,0 +1,8 @@
+#pragma once
+#include <definitions.hpp>
+
+namespace resolver {
+
+void resolve(Node *root);
+
+} // namespace resolver
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <definitions.hpp>
+#include <string>
+
+// the loops behind the array operators, compiled for sse4.1 and avx2 next
+// to a scalar fallback; the widest level the cpu supports is picked when
+// the program starts
+namespace simd {
+
+enum class Level : uint8_t { SCALAR, SSE4, AVX2 };
+
+const std::string LevelNames[] = {"scalar", "sse4.1", "avx2"};
+
+// which side of a binop is a single value applied to every element
+enum class Broadcast : uint8_t { NONE, LEFT, RIGHT };
+
+Level supported();
+
+Level level();
+
+// runs the kernels at a lower level, for comparisons; capped at supported()
+void set_level(Level level);
+
+// out[i] = x[i] op y[i] for PLUS, MINUS, MUL and DIV, out may be x or y;
+// ints wrap around and divide one element at a time, zero divisors are
+// the caller's to reject
+void binop(BinOpType op, const int32_t *x, const int32_t *y, int32_t *out,
+           size_t n, Broadcast broadcast = Broadcast::NONE);
+void binop(BinOpType op, const float *x, const float *y, float *out, size_t n,
+           Broadcast broadcast = Broadcast::NONE);
+
+void to_float(const int32_t *x, float *out, size_t n);
+
+// sums add into eight interleaved lanes combined in a fixed order, so a
+// float sum is the same at every level
+int32_t sum(const int32_t *x, size_t n);
+float sum(const float *x, size_t n);
+
+// n must not be 0
+int32_t min(const int32_t *x, size_t n);
+float min(const float *x, size_t n);
+int32_t max(const int32_t *x, size_t n);
+float max(const float *x, size_t n);
+
+} // namespace simd
@@ -0,0 +1,49 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running batches of indexed tasks, the
+// thread that starts a batch works on it too.
+class ThreadPool {
+public:
+  // threads taking part in a batch, the calling thread included
+  explicit ThreadPool(size_t threads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  // calls task(i) for every i below count and returns once all are done;
+  // a batch started from inside a task runs on its thread alone. The first
+  // exception a task throws is rethrown once the batch is done
+  void run(size_t count, const std::function<void(size_t)> &task);
+
+  [[nodiscard]] size_t size() const { return workers.size() + 1; }
+
+  // the interpreter's pool, created with shared_size threads on first use
+  static inline size_t shared_size =
+      std::max(1u, std::thread::hardware_concurrency());
+  static ThreadPool &shared();
+
+private:
+  void work();
+  void drain();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(size_t)> *task = nullptr;
+  size_t count = 0;
+  std::atomic<size_t> next = 0;
+  size_t busy = 0;
+  uint64_t batch = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Wall time and peak resident set size of the interpreter's phases, a
+// phase lasts until the next one begins or end() is called.
+class Timings {
+public:
+  void begin(std::string_view phase);
+  void end();
+
+  // on stderr, as a table or as a JSON object
+  void report(bool json) const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Phase {
+    std::string name;
+    double milliseconds = 0;
+    long peak_rss_kb = 0;
+  };
+
+  std::vector<Phase> phases;
+  clock::time_point start;
+  bool running = false;
+};
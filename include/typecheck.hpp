@@ -0,0 +1,16 @@
+#pragma once
+#include <definitions.hpp>
+
+namespace typecheck {
+
+struct Stats {
+  size_t specialized = 0;
+  size_t dynamic = 0;
+};
+
+// infers the type of every expression from the declarations, reports type
+// errors and specializes binops, stores and call arguments whose operand
+// types are known, runs on the resolved tree
+Stats check(Node *root);
+
+} // namespace typecheck
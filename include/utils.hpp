@@ -1,21 +1,57 @@
 #pragma once
 
 #include <fstream>
+#include <memory>
 #include <string>
+#include <string_view>
 
 namespace utils {
 
 static std::string read_entire_file(std::ifstream &f) {
-  std::string output{};
-  while (!f.eof()) {
-    char buffer[1024] = {};
-    f.read(buffer, 1024);
-    const size_t num_bytes = f.gcount();
-    if (num_bytes == 0)
-      break;
-    output += std::string(buffer, num_bytes);
+  f.seekg(0, std::ios::end);
+  const std::streamoff size = f.tellg();
+  f.seekg(0, std::ios::beg);
+  if (size <= 0) {
+    // not seekable, read it in chunks
+    f.clear();
+    std::string output{};
+    char buffer[1 << 16];
+    while (f.read(buffer, sizeof(buffer)) || f.gcount() > 0)
+      output.append(buffer, f.gcount());
+    return output;
   }
+  std::string output(static_cast<size_t>(size), '\0');
+  f.read(output.data(), size);
+  output.resize(f.gcount());
   return output;
 }
 
+// A read-only source buffer, memory mapped when possible.
+class Source {
+public:
+  static std::shared_ptr<Source> open(const std::string &filename);
+  // nullptr when the file cannot be read
+  static std::shared_ptr<Source> try_open(const std::string &filename);
+  static std::shared_ptr<Source> from_string(std::string contents,
+                                             std::string name = "<memory>");
+
+  Source(const Source &) = delete;
+  Source &operator=(const Source &) = delete;
+  ~Source();
+
+  [[nodiscard]] const char *data() const { return buffer; }
+  [[nodiscard]] size_t size() const { return length; }
+  [[nodiscard]] bool mapped() const { return is_mapped; }
+  [[nodiscard]] const std::string &name() const { return filename; }
+
+private:
+  Source() = default;
+
+  std::string filename;
+  std::string contents;
+  const char *buffer = nullptr;
+  size_t length = 0;
+  bool is_mapped = false;
+};
+
 } // namespace utils
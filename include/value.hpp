@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum Type : int {
+  INT = 0,
+  FLOAT,
+  STRING,
+  BOOL,
+  CHAR,
+  INT_ARRAY,
+  FLOAT_ARRAY,
+  VOID,
+  UNKNOWN
+};
+
+const std::string TypeNames[] = {"INT",  "FLOAT",     "STRING",      "BOOL",
+                                 "CHAR", "INT_ARRAY", "FLOAT_ARRAY", "VOID",
+                                 "UNKNOWN"};
+
+class Strings;
+
+struct Value {
+  Type type = VOID;
+  union {
+    int i;
+    float f;
+    bool b;
+    char c;
+    // strings, see Strings, and arrays, see array.hpp
+    uint32_t handle;
+  };
+
+  // lang's, kept until the process exits
+  static Strings process_strings;
+  // the strings of the program on this thread
+  static inline thread_local Strings *strings = &process_strings;
+
+  Value() : i(0) {}
+  Value(const int x) : type(INT), i(x) {}
+  Value(const float x) : type(FLOAT), f(x) {}
+  Value(const bool x) : type(BOOL), i(0) { b = x; }
+  Value(const char x) : type(CHAR), i(0) { c = x; }
+
+  static Value string(std::string_view str);
+
+  [[nodiscard]] inline const std::string &str() const;
+
+  [[nodiscard]] bool has_value() const { return type != VOID; }
+
+  [[nodiscard]] int to_int() const {
+    switch (type) {
+    case INT:
+      return i;
+    case FLOAT:
+      return static_cast<int>(f);
+    case BOOL:
+      return b;
+    case CHAR:
+      return c;
+    default:
+      return 0;
+    }
+  }
+
+  void reset() { *this = Value(); }
+};
+
+static_assert(sizeof(Value) == 8);
+
+// a program's interned strings, equal strings share a handle. They live in
+// chunks that never move, chunk k holds first_chunk << k of them, so at()
+// reads without a lock while other threads intern
+// print templates: literal text and `$name` references, see eval.hpp
+struct Segment {
+  std::string text;
+  bool variable = false;
+};
+
+class Strings {
+public:
+  Strings() = default;
+  Strings(const Strings &) = delete;
+  Strings &operator=(const Strings &) = delete;
+
+  uint32_t intern(std::string_view str);
+
+  [[nodiscard]] const std::string &at(const uint32_t handle) const {
+    return slot(handle);
+  }
+
+  // handles below the size stay valid through release
+  uint32_t size();
+
+  // forgets the strings interned since size() returned mark
+  void release(uint32_t mark);
+
+  // the template a string splits into, split once per handle and dropped
+  // with the string by release
+  const std::vector<Segment> &
+  segments(uint32_t handle, std::vector<Segment> (*split)(std::string_view));
+
+private:
+  std::string &slot(const uint32_t handle) const {
+    const size_t k = std::bit_width(handle / first_chunk + 1) - 1;
+    const size_t begin = first_chunk * ((size_t{1} << k) - 1);
+    return chunks[k][handle - begin];
+  }
+
+  static constexpr size_t first_chunk = 1024;
+  std::array<std::unique_ptr<std::string[]>, 32> chunks;
+  uint32_t count = 0;
+  std::unordered_map<std::string_view, uint32_t> handles;
+  std::unordered_map<uint32_t, std::vector<Segment>> templates;
+  std::mutex mutex;
+};
+
+const std::string &Value::str() const { return strings->at(handle); }
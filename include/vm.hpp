@@ -0,0 +1,8 @@
+#pragma once
+#include <bytecode.hpp>
+
+namespace vm {
+
+void run(const bytecode::Program &program);
+
+} // namespace vm
@@ -1,28 +1,280 @@
+#include <charconv>
 #include <memory>
 #include <print>
-#define DEBUG_MODE 0
 
+#include <array.hpp>
+#include <bytecode.hpp>
+#include <cache.hpp>
 #include <definitions.hpp>
+#include <error.hpp>
 #include <eval.hpp>
+#include <flat_ast.hpp>
+#include <jit.hpp>
 #include <lexer.hpp>
-#include <parser.hpp>
+#include <memo.hpp>
+#include <optimizer.hpp>
+#include <parallel.hpp>
+#include <profile.hpp>
+#include <program.hpp>
+#include <resolver.hpp>
+#include <thread_pool.hpp>
+#include <timings.hpp>
+#include <typecheck.hpp>
+#include <utils.hpp>
+#include <vm.hpp>
 
 using namespace lexer;
 
-int main(const int argc, char **argv) {
-  if (argc < 2) {
+int main(const int argc, char **argv) try {
+  std::vector<std::string> filenames;
+  std::string engine = "tree";
+  bool dump_bytecode = false;
+  bool ast_stats = false;
+  bool dump_flat = false;
+  bool dump_ast = false;
+  bool optimize = true;
+  bool cache_enabled = true;
+  bool line_buffered = false;
+  bool output_stats = false;
+  bool jit_stats = false;
+  bool memoize = false;
+  size_t memo_capacity = memo::default_capacity;
+  bool dump_tokens = false;
+  bool timings_report = false;
+  bool timings_json = false;
+  size_t output_buffer = Output::default_size;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string_view arg(argv[i]);
+    if (arg.starts_with("--engine=")) {
+      engine = arg.substr(std::string_view("--engine=").size());
+    } else if (arg == "--dump-bytecode") {
+      dump_bytecode = true;
+    } else if (arg == "--ast-stats") {
+      ast_stats = true;
+    } else if (arg == "--dump-flat") {
+      dump_flat = true;
+    } else if (arg == "--dump-ast") {
+      dump_ast = true;
+    } else if (arg == "--no-optimize") {
+      optimize = false;
+    } else if (arg == "--no-cache") {
+      cache_enabled = false;
+    } else if (arg == "--line-buffered") {
+      line_buffered = true;
+    } else if (arg == "--output-stats") {
+      output_stats = true;
+    } else if (arg == "--dump-tokens") {
+      dump_tokens = true;
+    } else if (arg == "--timings" || arg == "--timings=json") {
+      timings_report = true;
+      timings_json = arg == "--timings=json";
+    } else if (arg == "--profile") {
+      profile::enabled = true;
+    } else if (arg == "--jit") {
+      jit::enabled = true;
+    } else if (arg == "--jit-stats") {
+      jit::enabled = true;
+      jit_stats = true;
+    } else if (arg == "--memoize") {
+      memoize = true;
+    } else if (arg.starts_with("--memoize=")) {
+      const auto size = arg.substr(std::string_view("--memoize=").size());
+      memoize = true;
+      if (const auto [ptr, ec] = std::from_chars(
+              size.data(), size.data() + size.size(), memo_capacity);
+          ec != std::errc{} || ptr != size.data() + size.size() ||
+          memo_capacity == 0) {
+        std::println("[ERROR] invalid memo cache size '{}'", size);
+        return 1;
+      }
+    } else if (arg.starts_with("--output-buffer=")) {
+      const auto size = arg.substr(std::string_view("--output-buffer=").size());
+      if (const auto [ptr, ec] = std::from_chars(
+              size.data(), size.data() + size.size(), output_buffer);
+          ec != std::errc{} || ptr != size.data() + size.size() ||
+          output_buffer == 0) {
+        std::println("[ERROR] invalid output buffer size '{}'", size);
+        return 1;
+      }
+    } else if (arg.starts_with("--threads=")) {
+      const auto count = arg.substr(std::string_view("--threads=").size());
+      size_t &threads = ThreadPool::shared_size;
+      if (const auto [ptr, ec] = std::from_chars(
+              count.data(), count.data() + count.size(), threads);
+          ec != std::errc{} || ptr != count.data() + count.size() ||
+          threads == 0) {
+        std::println("[ERROR] invalid thread count '{}'", count);
+        return 1;
+      }
+    } else {
+      filenames.emplace_back(arg);
+    }
+  }
+
+  if (filenames.empty()) {
     std::println("no file/s specified");
     return 1;
   }
-  std::string filename(argv[1]);
+  if (engine != "tree" && engine != "vm" && engine != "flat") {
+    std::println(
+        "[ERROR] unknown engine '{}', expected 'tree', 'vm' or 'flat'",
+        engine);
+    return 1;
+  }
+
+  if (profile::enabled && engine == "vm") {
+    std::println("[ERROR] --profile needs the tree or flat engine");
+    return 1;
+  }
+
+  State::output->configure(output_buffer, line_buffered);
+
+  Timings timings;
+  timings.begin("load");
+  std::vector<std::shared_ptr<utils::Source>> sources;
+  for (const auto &filename : filenames)
+    sources.push_back(utils::Source::open(filename));
+
+  // a cached program skips every phase up to execution, the dumps need them
+  const bool use_cache = cache_enabled && !dump_tokens && !dump_ast;
+  const std::string cache_path = cache::path(filenames.front());
+  uint64_t cache_key = 0;
+  std::unique_ptr<cache::Program> cached;
+  if (use_cache) {
+    timings.begin("cache load");
+    cache_key = cache::key(sources, optimize);
+    cached = cache::load(cache_path, cache_key);
+  }
 
-  lexer::Lexer l(filename);
+  std::vector<std::unique_ptr<program::File>> files;
+  CompilationUnit compiled;
+  const CompilationUnit &unit = cached != nullptr ? cached->unit : compiled;
+  Node *root = unit.root;
 
-  const auto root = std::make_shared<Node>();
-  root->type = NodeType::ROOT_NODE;
-  root->name = "Program";
+  if (cached == nullptr) {
+    // a single file keeps its lex and parse phases apart, several are
+    // parsed in parallel and only the whole is timed
+    if (sources.size() == 1) {
+      files.push_back(program::parse(sources.front(), &timings, dump_tokens));
+    } else {
+      timings.begin("parse");
+      if (dump_tokens) {
+        for (const auto &source : sources)
+          files.push_back(program::parse(source, nullptr, true));
+      } else {
+        files = program::parse_all(sources, ThreadPool::shared());
+      }
+    }
 
-  parser::generate_expression(l, root);
-  eval(root);
+    timings.begin("link");
+    program::link(files, root);
+    timings.begin("resolve");
+    resolver::resolve(root);
+    timings.begin("typecheck");
+    const auto types = typecheck::check(root);
+    timings.end();
+
+    if (dump_ast) {
+      std::println("[INFO] types: {} specialized, {} dynamic",
+                   types.specialized, types.dynamic);
+      std::println("[INFO] ast before optimization");
+      ::dump_ast(root);
+    }
+    if (optimize) {
+      timings.begin("optimize");
+      const auto stats = optimizer::optimize(root);
+      timings.end();
+      if (dump_ast) {
+        std::println("[INFO] ast after optimization: {} folded, {} removed",
+                     stats.folded, stats.removed);
+        ::dump_ast(root);
+      }
+    }
+
+    if (use_cache) {
+      timings.begin("cache save");
+      cache::save(cache_path, cache_key, root);
+      timings.end();
+    }
+  }
+
+  // loop plans are not part of the cache, they are quick to rebuild
+  const parallel::Plans plans = parallel::analyze(root);
+  parallel::context = {&plans, &ThreadPool::shared()};
+  parallel::warn_sequential(plans, engine);
+  memo::Caches caches;
+  if (memoize)
+    caches = memo::analyze(root, memo_capacity);
+  array::analyze(root);
+
+  if (ast_stats) {
+    size_t used = unit.arena.bytes_used();
+    size_t reserved = unit.arena.bytes_reserved();
+    size_t blocks = unit.arena.block_count();
+    for (const auto &file : files) {
+      used += file->unit.arena.bytes_used();
+      reserved += file->unit.arena.bytes_reserved();
+      blocks += file->unit.arena.block_count();
+    }
+    std::println(stderr,
+                 "[INFO] ast: {} nodes, {} bytes used, {} bytes reserved in "
+                 "{} blocks",
+                 count_nodes(root), used, reserved, blocks);
+  }
+
+  if (engine == "flat" || dump_flat) {
+    timings.begin("flatten");
+    const auto ast = flat::flatten(root);
+    timings.end();
+    if (dump_flat)
+      flat::dump(ast);
+    if (engine == "flat") {
+      timings.begin("execute");
+      flat::run(ast);
+    }
+  } else if (engine == "vm" || dump_bytecode) {
+    timings.begin("compile");
+    const auto program = bytecode::compile(root);
+    timings.end();
+    if (dump_bytecode)
+      bytecode::disassemble(program);
+    if (engine == "vm") {
+      timings.begin("execute");
+      vm::run(program);
+    }
+  } else {
+    timings.begin("execute");
+    eval(root);
+  }
+
+  State::output->flush();
+  timings.end();
+  if (timings_report)
+    timings.report(timings_json);
+  if (output_stats) {
+    std::println(stderr,
+                 "[INFO] output: {} bytes written in {} flushes, {} byte "
+                 "buffer{}",
+                 State::output->bytes_written(), State::output->flush_count(),
+                 State::output->capacity(),
+                 line_buffered ? ", line buffered" : "");
+  }
+  if (profile::enabled)
+    profile::report();
+  if (memoize)
+    memo::report(caches, memo_capacity);
+  if (jit_stats) {
+    const auto &stats = jit::stats();
+    std::println(stderr,
+                 "[INFO] jit: {} functions compiled, {} rejected, {} bytes of "
+                 "code",
+                 stats.compiled, stats.rejected, stats.code_bytes);
+  }
   return 0;
+} catch (const Error &error) {
+  // what the program printed comes before the error
+  State::output->flush();
+  std::println("[ERROR] {}", error.what());
+  return error.status;
 }
@@ -0,0 +1,38 @@
+#include <arena.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+void *Arena::allocate(const size_t size, const size_t alignment) {
+  auto address = reinterpret_cast<uintptr_t>(cursor);
+  auto aligned = (address + alignment - 1) & ~(alignment - 1);
+  if (cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+    const size_t capacity = std::max(block_size, size + alignment);
+    blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(capacity));
+    cursor = blocks.back().get();
+    limit = cursor + capacity;
+    reserved += capacity;
+    address = reinterpret_cast<uintptr_t>(cursor);
+    aligned = (address + alignment - 1) & ~(alignment - 1);
+  }
+  cursor = reinterpret_cast<std::byte *>(aligned + size);
+  used += size;
+  return reinterpret_cast<void *>(aligned);
+}
+
+std::string_view Arena::copy(const std::string_view str) {
+  if (str.empty())
+    return {};
+  auto *data = static_cast<char *>(allocate(str.size(), 1));
+  std::memcpy(data, str.data(), str.size());
+  return {data, str.size()};
+}
+
+void Arena::release() {
+  for (auto it = finalizers.rbegin(); it != finalizers.rend(); ++it)
+    it->second(it->first);
+  finalizers.clear();
+  blocks.clear();
+  cursor = limit = nullptr;
+  used = reserved = objects = 0;
+}
@@ -0,0 +1,408 @@
+#include <array.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <error.hpp>
+#include <eval.hpp>
+#include <format>
+#include <map>
+#include <set>
+#include <simd.hpp>
+
+namespace array {
+
+Heap process_heap;
+
+Value Heap::create(const Type type, const size_t size) {
+  Value v;
+  v.type = type;
+  void *data = std::malloc(std::max<size_t>(size, 1) * 4);
+  const std::scoped_lock lock(mutex);
+  if (!released.empty()) {
+    v.handle = released.back();
+    released.pop_back();
+  } else {
+    v.handle = count++;
+    const size_t k = std::bit_width(v.handle / first_chunk + 1) - 1;
+    if (chunks[k] == nullptr)
+      chunks[k] = std::make_unique<Array[]>(first_chunk << k);
+  }
+  at(v.handle) = {type, static_cast<uint32_t>(size), data};
+  return v;
+}
+
+void Heap::release(const uint32_t handle) {
+  const std::scoped_lock lock(mutex);
+  std::free(at(handle).data);
+  at(handle) = {};
+  released.push_back(handle);
+}
+
+size_t Heap::size() {
+  const std::scoped_lock lock(mutex);
+  return count - released.size();
+}
+
+void Heap::clear() {
+  const std::scoped_lock lock(mutex);
+  // the chunks are kept for the next run
+  for (uint32_t handle = 0; handle < count; handle++) {
+    std::free(at(handle).data);
+    at(handle) = {};
+  }
+  count = 0;
+  released.clear();
+}
+
+namespace {
+
+const Array &checked(const Value &x, const std::string_view what) {
+  if (!is_array(x.type))
+    throw Error(std::format("type error: {} expects an array, got {}", what,
+                            TypeNames[x.type]));
+  return get(x);
+}
+
+size_t position(const Array &a, const Value &index) {
+  if (index.type != INT)
+    type_mismatch(INT, index.type);
+  if (index.i < 0 || static_cast<uint32_t>(index.i) >= a.size)
+    throw Error(std::format(
+        "index {} is out of bounds for an array of {} elements", index.i,
+        a.size));
+  return index.i;
+}
+
+// a variable by the function of its frame and its slot
+using Variable = std::pair<Function *, int>;
+
+// what becomes of a value: dropped, read by an operator, or kept where it
+// may outlive the variable it came from
+enum class Use { DISCARDED, CONSUMED, KEPT };
+
+struct Ownership {
+  Function *globals;
+  // arguments the callee may keep, the others are only read during the call
+  std::set<Variable> escaping;
+  // the globals a function and its callees assign
+  std::map<const Function *, std::set<int>> writes;
+  std::set<Variable> shared;
+  // the assignments storing new arrays, and the variables they store into
+  std::vector<std::pair<Node *, Variable>> stores;
+
+  [[nodiscard]] Variable variable(const Node *node, Function *owner) const {
+    return {node->depth == 0 ? globals : owner, node->slot};
+  }
+
+  // the node below the expression and call wrappers
+  static const Node *unwrap(const Node *node) {
+    while (node != nullptr && !node->body.empty() &&
+           (node->type == NodeType::EXPRESSION ||
+            (node->type == NodeType::IDENTIFIER && node->slot < 0)))
+      node = node->body.front();
+    return node;
+  }
+
+  // a new array whenever it evaluates to one
+  static bool fresh(const Node *node) {
+    node = unwrap(node);
+    if (node == nullptr)
+      return false;
+    if (node->type == NodeType::ARRAY)
+      return true;
+    return node->type == NodeType::BINOP &&
+           (node->value_type == UNKNOWN || is_array(node->value_type)) &&
+           (node->binop_type == BinOpType::PLUS ||
+            node->binop_type == BinOpType::MINUS ||
+            node->binop_type == BinOpType::MUL ||
+            node->binop_type == BinOpType::DIV);
+  }
+
+  void block(const NodeList &body, Function *owner, const Use last,
+             const bool parallel) {
+    for (size_t i = 0; i < body.size(); i++) {
+      visit(body.items[i], owner,
+            i + 1 == body.size() ? last : Use::DISCARDED, parallel);
+    }
+  }
+
+  void visit(Node *node, Function *owner, const Use use, const bool parallel) {
+    if (node == nullptr)
+      return;
+    switch (node->type) {
+    case NodeType::ROOT_NODE:
+      block(node->body, owner, Use::DISCARDED, false);
+      return;
+    case NodeType::FUNCTION_DECLARATION: {
+      Node *body = node->body.front();
+      Function *function = body->function;
+      function->released_slots.clear();
+      // arguments hold the caller's arrays
+      for (int i = 0; i < static_cast<int>(function->arguments.size()); i++)
+        shared.insert({function, i});
+      // the value of the last statement is the result
+      block(body->body, function,
+            function->return_type == VOID ? Use::DISCARDED : Use::KEPT,
+            false);
+      return;
+    }
+    case NodeType::FUNCTION_CALL: {
+      Function *callee = node->body.back()->function;
+      int i = 0;
+      for (Node *n : node->body) {
+        if (n->type != NodeType::FUNCTION_CALL_PARAM)
+          break;
+        // a global the callee assigns may be freed under its argument
+        const Variable argument{callee, i++};
+        for (Node *value : n->body) {
+          const Node *read = unwrap(value);
+          const bool kept = escaping.contains(argument) ||
+                            (read->type == NodeType::IDENTIFIER &&
+                             read->depth == 0 && read->slot >= 0 &&
+                             writes[callee].contains(read->slot));
+          visit(value, owner, kept ? Use::KEPT : Use::CONSUMED, parallel);
+        }
+      }
+      const std::set<int> called = writes[callee];
+      writes[owner].insert(called.begin(), called.end());
+      return;
+    }
+    case NodeType::IDENTIFIER:
+      if (node->slot >= 0 && use == Use::KEPT) {
+        shared.insert(variable(node, owner));
+        if (node->depth != 0 && owner != globals &&
+            node->slot < static_cast<int>(owner->arguments.size()))
+          escaping.insert(variable(node, owner));
+      }
+      for (Node *n : node->body)
+        visit(n, owner, use, parallel);
+      return;
+    case NodeType::EXPRESSION:
+      for (Node *n : node->body)
+        visit(n, owner, use, parallel);
+      return;
+    case NodeType::RETURN:
+      // the vm returns from wherever it is
+      for (Node *n : node->body)
+        visit(n, owner, Use::KEPT, parallel);
+      return;
+    case NodeType::VARIABLE_DECLARATION:
+      for (Node *n : node->body)
+        visit(n, owner, Use::DISCARDED, parallel);
+      return;
+    case NodeType::LOOP_DECLARATION:
+      visit(node->condition, owner, Use::CONSUMED, parallel);
+      visit(node->body.front(), owner, use, parallel || node->parallel);
+      return;
+    case NodeType::LOOP_BODY:
+      block(node->body, owner, use, parallel);
+      return;
+    case NodeType::BINOP:
+      if (node->binop_type == BinOpType::ASSIGNMENT) {
+        visit(node->right, owner, Use::KEPT, parallel);
+        if (node->left->slot < 0)
+          return;
+        const Variable target = variable(node->left, owner);
+        if (target.first == globals)
+          writes[owner].insert(target.second);
+        if (use == Use::KEPT || parallel || !fresh(node->right))
+          shared.insert(target);
+        else
+          stores.emplace_back(node, target);
+        return;
+      }
+      visit(node->left, owner, Use::CONSUMED, parallel);
+      visit(node->right, owner, Use::CONSUMED, parallel);
+      if (fresh(node)) {
+        node->releases = (fresh(node->left) ? release_left : 0) |
+                         (fresh(node->right) ? release_right : 0);
+      }
+      return;
+    case NodeType::ELEMENT_ASSIGNMENT:
+      visit(node->left->left, owner, Use::CONSUMED, parallel);
+      visit(node->left->right, owner, Use::CONSUMED, parallel);
+      visit(node->right, owner, Use::CONSUMED, parallel);
+      return;
+    case NodeType::INDEX:
+      visit(node->left, owner, Use::CONSUMED, parallel);
+      visit(node->right, owner, Use::CONSUMED, parallel);
+      node->releases = fresh(node->left) ? release_left : 0;
+      return;
+    case NodeType::LENGTH:
+    case NodeType::REDUCTION:
+      visit(node->body.front(), owner, Use::CONSUMED, parallel);
+      node->releases = fresh(node->body.front()) ? release_left : 0;
+      return;
+    case NodeType::PRINT:
+    case NodeType::LITERAL:
+    case NodeType::ARRAY:
+      visit(node->condition, owner, Use::CONSUMED, parallel);
+      for (Node *n : node->body)
+        visit(n, owner, Use::CONSUMED, parallel);
+      return;
+    default:
+      visit(node->left, owner, Use::KEPT, parallel);
+      visit(node->right, owner, Use::KEPT, parallel);
+      visit(node->condition, owner, Use::KEPT, parallel);
+      for (Node *n : node->body)
+        visit(n, owner, Use::KEPT, parallel);
+      return;
+    }
+  }
+};
+
+void set(const Array &a, const size_t i, const Value &value) {
+  const Value x = convert(value, Specialization::CHECKED, element_type(a.type));
+  if (a.type == INT_ARRAY)
+    a.ints()[i] = x.i;
+  else
+    a.floats()[i] = x.f;
+}
+
+} // namespace
+
+void analyze(Node *root) {
+  Ownership ownership{root->function};
+  // a call's arguments depend on what its callee, declared anywhere, does
+  // with them; repeated until that settles
+  for (;;) {
+    const auto escaping = ownership.escaping;
+    const auto writes = ownership.writes;
+    ownership.shared.clear();
+    ownership.stores.clear();
+    ownership.visit(root, root->function, Use::DISCARDED, false);
+    if (ownership.escaping == escaping && ownership.writes == writes)
+      break;
+  }
+  for (auto &[node, target] : ownership.stores) {
+    if (ownership.shared.contains(target))
+      continue;
+    node->releases = release_target;
+    auto &slots = target.first->released_slots;
+    if (target.first != root->function &&
+        std::ranges::find(slots, target.second) == slots.end())
+      slots.push_back(target.second);
+  }
+}
+
+void release(const Value &x) {
+  if (is_array(x.type))
+    heap->release(x.handle);
+}
+
+Value make(const Type type, const size_t size) {
+  const Value result = heap->create(type, size);
+  std::memset(get(result).data, 0, size * 4);
+  return result;
+}
+
+Value allocate(const Type type, const Value &length) {
+  if (length.type != INT)
+    type_mismatch(INT, length.type);
+  if (length.i < 0)
+    throw Error(std::format("array length must not be negative, got {}",
+                            length.i));
+  return make(type, length.i);
+}
+
+Value literal(Type type, const std::span<const Value> elements) {
+  if (!is_array(type)) {
+    type = std::ranges::any_of(elements,
+                               [](const Value &x) { return x.type == FLOAT; })
+               ? FLOAT_ARRAY
+               : INT_ARRAY;
+  }
+  const Value result = heap->create(type, elements.size());
+  for (size_t i = 0; i < elements.size(); i++)
+    set(get(result), i, elements[i]);
+  return result;
+}
+
+Value load(const Value &array, const Value &index) {
+  const Array &a = checked(array, "indexing");
+  const size_t i = position(a, index);
+  if (a.type == INT_ARRAY)
+    return a.ints()[i];
+  return a.floats()[i];
+}
+
+void store(const Value &array, const Value &index, const Value &value) {
+  const Array &a = checked(array, "indexing");
+  set(a, position(a, index), value);
+}
+
+Value length(const Value &array) {
+  return static_cast<int>(checked(array, "len").size);
+}
+
+Value reduce(const Value &array, const BinOpType op) {
+  const std::string_view name = op == BinOpType::PLUS        ? "sum"
+                                : op == BinOpType::LESS_THAN ? "min"
+                                                             : "max";
+  const Array &a = checked(array, name);
+  if (op == BinOpType::PLUS) {
+    if (a.type == INT_ARRAY)
+      return simd::sum(a.ints(), a.size);
+    return simd::sum(a.floats(), a.size);
+  }
+  if (a.size == 0)
+    throw Error(std::format("{} of an empty array", name));
+  if (op == BinOpType::LESS_THAN) {
+    if (a.type == INT_ARRAY)
+      return simd::min(a.ints(), a.size);
+    return simd::min(a.floats(), a.size);
+  }
+  if (a.type == INT_ARRAY)
+    return simd::max(a.ints(), a.size);
+  return simd::max(a.floats(), a.size);
+}
+
+Value binop(const Value &x, const Value &y, const BinOpType op) {
+  const Type type = result_type(x.type, y.type, op);
+  const bool left = is_array(x.type);
+  const bool right = is_array(y.type);
+  const size_t n = left ? get(x).size : get(y).size;
+  if (left && right && get(y).size != n)
+    throw Error(std::format("{} on arrays of {} and {} elements",
+                            BinOpTypeNames[static_cast<int>(op)], n,
+                            get(y).size));
+  const simd::Broadcast broadcast = !left    ? simd::Broadcast::LEFT
+                                    : !right ? simd::Broadcast::RIGHT
+                                             : simd::Broadcast::NONE;
+  if (type == INT_ARRAY && op == BinOpType::DIV) {
+    const int32_t *divisors = right ? get(y).ints() : &y.i;
+    if (std::find(divisors, divisors + (right ? n : 1), 0) !=
+        divisors + (right ? n : 1))
+      division_by_zero();
+  }
+  const Value result = heap->create(type, n);
+  const Array &out = get(result);
+
+  if (type == INT_ARRAY) {
+    simd::binop(op, left ? get(x).ints() : &x.i, right ? get(y).ints() : &y.i,
+                out.ints(), n, broadcast);
+    return result;
+  }
+
+  // an int array is converted into the result, the kernel then works on it
+  // in place; a float result has at most one int array operand
+  const auto floats = [&](const Value &v, float &scalar) -> const float * {
+    if (v.type == FLOAT_ARRAY)
+      return get(v).floats();
+    if (v.type == INT_ARRAY) {
+      simd::to_float(get(v).ints(), out.floats(), n);
+      return out.floats();
+    }
+    scalar = v.type == FLOAT ? v.f : static_cast<float>(v.i);
+    return &scalar;
+  };
+  float a = 0;
+  float b = 0;
+  const float *xs = floats(x, a);
+  const float *ys = floats(y, b);
+  simd::binop(op, xs, ys, out.floats(), n, broadcast);
+  return result;
+}
+
+} // namespace array
@@ -0,0 +1,308 @@
+#include <bytecode.hpp>
+
+#include <print>
+#include <ranges>
+#include <unordered_map>
+
+namespace bytecode {
+
+namespace {
+
+struct Compiler {
+  Program program;
+  std::unordered_map<const Node *, int> function_ids;
+  std::vector<const Node *> bodies;
+  int current = 0;
+
+  int add_constant(const Value &value) {
+    program.constants.push_back(value);
+    return static_cast<int>(program.constants.size() - 1);
+  }
+
+  size_t emit(const OpCode op, const int32_t a = 0, const int32_t b = 0) {
+    program.code.push_back({op, a, b});
+    return program.code.size() - 1;
+  }
+
+  int add_local(const std::string &name) {
+    auto &f = program.functions[current];
+    f.locals.push_back(name);
+    f.num_locals = static_cast<int>(f.locals.size());
+    return f.num_locals - 1;
+  }
+
+  void collect(const Node *node) {
+    if (node->type == NodeType::FUNCTION_DECLARATION) {
+      const Node *body = node->body.front();
+      function_ids[body] = static_cast<int>(program.functions.size());
+      bodies.push_back(body);
+      auto &f = program.functions.emplace_back();
+      f.name = body->function->name;
+      f.arity = static_cast<int>(body->function->arguments.size());
+      f.return_type = body->function->return_type;
+      f.locals = body->function->slot_names;
+      f.num_locals = body->function->num_slots;
+      f.function = body->function;
+    }
+    if (node->type == NodeType::FUNCTION_CALL)
+      return;
+    for (const auto &n : node->body)
+      collect(n);
+  }
+
+  bool load(const Node &node) {
+    if (node.slot < 0)
+      return false;
+    emit(node.depth == 0 ? OpCode::LOAD_GLOBAL : OpCode::LOAD_LOCAL,
+         node.slot);
+    return true;
+  }
+
+  // b frees the array the store overwrites, see array::analyze
+  void store(const Node &node, const uint8_t releases) {
+    emit(node.depth == 0 ? OpCode::STORE_GLOBAL : OpCode::STORE_LOCAL,
+         node.slot, releases);
+  }
+
+  void emit_block(const NodeList &body) {
+    if (body.empty()) {
+      emit(OpCode::PUSH_EMPTY);
+      return;
+    }
+    size_t count = 0;
+    for (const auto &n : body) {
+      emit_node(n);
+      if (++count != body.size())
+        emit(OpCode::POP);
+    }
+  }
+
+  void emit_print(const Node *arg) {
+    if (arg->type == NodeType::LITERAL) {
+      for (const auto &segment : arg->body) {
+        if (segment->type == NodeType::LITERAL)
+          emit(OpCode::EMIT_CONST, add_constant(segment->value));
+        else if (load(*segment))
+          emit(OpCode::EMIT_VALUE);
+      }
+    } else if (arg->type == NodeType::IDENTIFIER) {
+      if (!load(*arg))
+        return;
+      emit(OpCode::EMIT_STRING);
+    } else {
+      return;
+    }
+    emit(OpCode::PRINT_LINE);
+  }
+
+  void emit_convert(const Node &node) {
+    if (node.specialization == Specialization::TO_FLOAT)
+      emit(OpCode::TO_FLOAT);
+    else if (node.specialization == Specialization::CHECKED)
+      emit(OpCode::CHECK_TYPE, node.value_type);
+  }
+
+  // mixed int and float operands are promoted before a float binop
+  void emit_binop(const Node *node) {
+    const auto op = static_cast<int32_t>(node->binop_type);
+    emit_node(node->left);
+    if (node->specialization == Specialization::INT_FLOAT)
+      emit(OpCode::TO_FLOAT);
+    emit_node(node->right);
+    switch (node->specialization) {
+    case Specialization::INT_INT:
+      emit(OpCode::BINOP_INT, op);
+      return;
+    case Specialization::FLOAT_INT:
+      emit(OpCode::TO_FLOAT);
+    case Specialization::FLOAT_FLOAT:
+    case Specialization::INT_FLOAT:
+      emit(OpCode::BINOP_FLOAT, op);
+      return;
+    default:
+      emit(OpCode::BINOP, op, node->releases);
+      return;
+    }
+  }
+
+  void emit_node(const Node *node) {
+    switch (node->type) {
+    case NodeType::FUNCTION_CALL: {
+      int arg_count = 0;
+      for (const auto &n : node->body) {
+        if (n->type != NodeType::FUNCTION_CALL_PARAM)
+          break;
+        if (n->body.empty())
+          emit(OpCode::PUSH_CONST, add_constant(0));
+        else
+          emit_node(n->body.front());
+        emit_convert(*n);
+        arg_count++;
+      }
+      emit(OpCode::CALL, function_ids.at(node->body.back()), arg_count);
+      return;
+    }
+    case NodeType::BINOP:
+      if (node->binop_type == BinOpType::ASSIGNMENT) {
+        emit_node(node->right);
+        emit_convert(*node);
+        store(*node->left, node->releases);
+        return;
+      }
+      emit_binop(node);
+      return;
+    case NodeType::LOOP_BODY:
+      emit_block(node->body);
+      return;
+    case NodeType::VARIABLE_DECLARATION:
+      for (const auto &n : node->body) {
+        if (n->type == NodeType::BINOP) {
+          emit_node(n);
+          emit(OpCode::POP);
+        }
+      }
+      break;
+    case NodeType::LITERAL:
+      emit(OpCode::PUSH_CONST, add_constant(node->value));
+      return;
+    case NodeType::RETURN:
+      if (node->body.empty())
+        emit(OpCode::PUSH_CONST, add_constant(node->value));
+      else
+        emit_block(node->body);
+      if (current != 0) {
+        if (program.functions[current].return_type == VOID) {
+          emit(OpCode::POP);
+          emit(OpCode::PUSH_EMPTY);
+        }
+        emit(OpCode::RETURN);
+      }
+      return;
+    case NodeType::IDENTIFIER:
+      if (load(*node))
+        return;
+    case NodeType::EXPRESSION:
+      if (!node->body.empty()) {
+        emit_node(node->body.front());
+        return;
+      }
+      break;
+    case NodeType::PRINT:
+      for (const auto &arg : node->body)
+        emit_print(arg);
+      break;
+    case NodeType::ARRAY:
+      if (node->condition != nullptr) {
+        emit_node(node->condition);
+        emit(OpCode::ALLOC_ARRAY, node->value_type);
+        return;
+      }
+      for (const auto &n : node->body)
+        emit_node(n);
+      emit(OpCode::MAKE_ARRAY, node->value_type,
+           static_cast<int32_t>(node->body.size()));
+      return;
+    case NodeType::INDEX:
+      emit_node(node->left);
+      emit_node(node->right);
+      emit(OpCode::LOAD_ELEMENT, node->releases);
+      return;
+    case NodeType::ELEMENT_ASSIGNMENT:
+      emit_node(node->left->left);
+      emit_node(node->left->right);
+      emit_node(node->right);
+      emit_convert(*node);
+      emit(OpCode::STORE_ELEMENT);
+      return;
+    case NodeType::LENGTH:
+      emit_node(node->body.front());
+      emit(OpCode::LENGTH, node->releases);
+      return;
+    case NodeType::REDUCTION:
+      emit_node(node->body.front());
+      emit(OpCode::REDUCE, static_cast<int32_t>(node->binop_type),
+           node->releases);
+      return;
+    case NodeType::LOOP_DECLARATION: {
+      const int index = node->slot;
+      const int loops = index + 1;
+      const int result = add_local("");
+      emit_node(node->condition);
+      emit(OpCode::STORE_LOCAL, loops);
+      emit(OpCode::POP);
+      emit(OpCode::PUSH_CONST, add_constant(0));
+      emit(OpCode::STORE_LOCAL, index);
+      emit(OpCode::POP);
+      emit(OpCode::PUSH_EMPTY);
+      emit(OpCode::STORE_LOCAL, result);
+      emit(OpCode::POP);
+      const size_t top = emit(OpCode::LOOP, index);
+      emit_node(node->body.front());
+      emit(OpCode::STORE_LOCAL, result);
+      emit(OpCode::POP);
+      emit(OpCode::INCREMENT, index);
+      emit(OpCode::JUMP, static_cast<int32_t>(top));
+      program.code[top].b = static_cast<int32_t>(program.code.size());
+      emit(OpCode::LOAD_LOCAL, result);
+      return;
+    }
+    default:
+      break;
+    }
+    emit(OpCode::PUSH_CONST, add_constant(0));
+  }
+
+  void compile_function(const Node *body) {
+    current = function_ids.at(body);
+    program.functions[current].entry = program.code.size();
+    emit_block(body->body);
+    if (program.functions[current].return_type == VOID) {
+      emit(OpCode::POP);
+      emit(OpCode::PUSH_EMPTY);
+    }
+    emit(OpCode::RETURN);
+  }
+
+  void compile(const Node *root) {
+    auto &main = program.functions.emplace_back();
+    main.name = "<main>";
+    main.locals = root->function->slot_names;
+    main.num_locals = root->function->num_slots;
+    collect(root);
+
+    current = 0;
+    for (const auto &n : root->body) {
+      if (n->type == NodeType::FUNCTION_DECLARATION)
+        continue;
+      emit_node(n);
+      emit(OpCode::POP);
+    }
+    emit(OpCode::HALT);
+
+    for (const auto &body : bodies)
+      compile_function(body);
+  }
+};
+
+} // namespace
+
+Program compile(const Node *root) {
+  Compiler compiler;
+  compiler.compile(root);
+  return std::move(compiler.program);
+}
+
+void disassemble(const Program &program) {
+  for (size_t f = 0; f < program.functions.size(); f++) {
+    const auto &fun = program.functions[f];
+    std::println("fn {} (arity {}, locals {}) @{}", fun.name, fun.arity,
+                 fun.num_locals, fun.entry);
+  }
+  for (size_t i = 0; i < program.code.size(); i++) {
+    const auto &in = program.code[i];
+    std::println("{:04} {:<12} {} {}", i,
+                 OpCodeNames[static_cast<int>(in.op)], in.a, in.b);
+  }
+}
+
+} // namespace bytecode
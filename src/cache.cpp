@@ -0,0 +1,459 @@
+#include <cache.hpp>
+
+#include <algorithm>
+#include <array.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace cache {
+
+namespace {
+
+constexpr uint32_t none = ~0u;
+constexpr char magic[4] = {'L', 'A', 'N', 'G'};
+
+// the file is a Header followed by its sections in the order of the
+// counts: nodes, child lists, functions, slots, string literals and the
+// text every name points into; records are read in place from the mapping
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t nodes;
+  uint32_t children;
+  uint32_t functions;
+  uint32_t slots;
+  uint32_t literals;
+  uint32_t text;
+};
+
+struct StringRef {
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
+struct NodeRecord {
+  uint32_t left;
+  uint32_t right;
+  uint32_t condition;
+  uint32_t body_begin;
+  uint32_t body_count;
+  uint32_t function;
+  StringRef name;
+  // the handle of a string is an index in the literals section
+  Value value;
+  int32_t slot;
+  int8_t depth;
+  uint8_t value_type;
+  uint8_t type;
+  uint8_t binop_type;
+  uint8_t specialization;
+  bool expression;
+  bool parallel;
+};
+
+// arguments and slots of a function, both are name and type pairs
+struct SlotRecord {
+  StringRef name;
+  Type type;
+};
+
+struct FunctionRecord {
+  StringRef name;
+  Type return_type;
+  uint32_t single_expression;
+  int32_t num_slots;
+  uint32_t arguments_begin;
+  uint32_t argument_count;
+  uint32_t slots_begin;
+  uint32_t slot_count;
+  uint32_t body;
+};
+
+static_assert(std::is_trivially_copyable_v<NodeRecord> &&
+              std::is_trivially_copyable_v<FunctionRecord> &&
+              std::is_trivially_copyable_v<SlotRecord>);
+static_assert(sizeof(Header) % 4 == 0 && sizeof(NodeRecord) % 4 == 0 &&
+              sizeof(FunctionRecord) % 4 == 0 && sizeof(SlotRecord) % 4 == 0);
+
+struct Writer {
+  std::vector<NodeRecord> nodes;
+  std::vector<uint32_t> children;
+  std::vector<FunctionRecord> functions;
+  std::vector<SlotRecord> slots;
+  std::vector<StringRef> literals;
+  std::string text;
+  std::unordered_map<const Node *, uint32_t> node_ids;
+  std::unordered_map<const Function *, uint32_t> function_ids;
+  std::unordered_map<std::string_view, StringRef> strings;
+
+  StringRef string(const std::string_view str) {
+    if (str.empty())
+      return {};
+    const auto [it, added] = strings.try_emplace(str);
+    if (added) {
+      it->second = {static_cast<uint32_t>(text.size()),
+                    static_cast<uint32_t>(str.size())};
+      text += str;
+    }
+    return it->second;
+  }
+
+  uint32_t add_function(const Function *function) {
+    if (function == nullptr)
+      return none;
+    if (const auto it = function_ids.find(function); it != function_ids.end())
+      return it->second;
+
+    const auto id = static_cast<uint32_t>(functions.size());
+    function_ids[function] = id;
+    FunctionRecord record{};
+    record.name = string(function->name);
+    record.return_type = function->return_type;
+    record.single_expression = function->single_expression;
+    record.num_slots = function->num_slots;
+    record.arguments_begin = static_cast<uint32_t>(slots.size());
+    record.argument_count = static_cast<uint32_t>(function->arguments.size());
+    for (const auto &[name, type] : function->arguments)
+      slots.push_back({string(name), type});
+    record.slots_begin = static_cast<uint32_t>(slots.size());
+    record.slot_count = static_cast<uint32_t>(function->slot_names.size());
+    for (size_t i = 0; i < function->slot_names.size(); i++)
+      slots.push_back({string(function->slot_names[i]),
+                       function->slot_types[i]});
+    functions.push_back(record);
+    const uint32_t body = add(function->body);
+    functions[id].body = body;
+    return id;
+  }
+
+  uint32_t add(const Node *node) {
+    if (node == nullptr)
+      return none;
+    if (const auto it = node_ids.find(node); it != node_ids.end())
+      return it->second;
+
+    const auto id = static_cast<uint32_t>(nodes.size());
+    node_ids[node] = id;
+    nodes.emplace_back();
+
+    NodeRecord record{};
+    record.name = string(node->name);
+    record.value = node->value;
+    if (node->value.type == STRING) {
+      record.value.handle = static_cast<uint32_t>(literals.size());
+      literals.push_back(string(node->value.str()));
+    }
+    record.slot = node->slot;
+    record.depth = static_cast<int8_t>(node->depth);
+    record.value_type = static_cast<uint8_t>(node->value_type);
+    record.type = static_cast<uint8_t>(node->type);
+    record.binop_type = static_cast<uint8_t>(node->binop_type);
+    record.specialization = static_cast<uint8_t>(node->specialization);
+    record.expression = node->expression;
+    record.parallel = node->parallel;
+    record.function = add_function(node->function);
+
+    // the children's range is taken first, their own children follow it
+    record.body_begin = static_cast<uint32_t>(children.size());
+    record.body_count = static_cast<uint32_t>(node->body.size());
+    children.resize(children.size() + node->body.size());
+    for (uint32_t i = 0; i < record.body_count; i++) {
+      const uint32_t child = add(node->body.items[i]);
+      children[record.body_begin + i] = child;
+    }
+
+    record.left = add(node->left);
+    record.right = add(node->right);
+    record.condition = add(node->condition);
+    nodes[id] = record;
+    return id;
+  }
+};
+
+template <typename T>
+void write(std::ofstream &out, const std::vector<T> &items) {
+  out.write(reinterpret_cast<const char *>(items.data()),
+            static_cast<std::streamsize>(items.size() * sizeof(T)));
+}
+
+// a section of count records starting at cursor, which is moved past it
+template <typename T>
+const T *section(const char *&cursor, const size_t count) {
+  const auto *items = reinterpret_cast<const T *>(cursor);
+  cursor += count * sizeof(T);
+  return items;
+}
+
+// what the evaluators use unchecked: enum values in range, and frame
+// slots within the globals or the frame of the function owning the node
+struct Validator {
+  const Function &globals;
+  // nodes on the current path and nodes already checked
+  std::unordered_map<const Node *, bool> seen;
+
+  static bool type(const Type t) { return t >= INT && t <= UNKNOWN; }
+
+  static bool function(const Function &f) {
+    return type(f.return_type) && f.num_slots >= 0 &&
+           f.arguments.size() <= static_cast<size_t>(f.num_slots) &&
+           f.slot_types.size() == static_cast<size_t>(f.num_slots) &&
+           std::ranges::all_of(f.arguments,
+                               [](const auto &a) { return type(a.second); }) &&
+           std::ranges::all_of(f.slot_types, type);
+  }
+
+  bool node(const Node *n, const Function *owner) {
+    if (n == nullptr)
+      return true;
+    if (const auto it = seen.find(n); it != seen.end())
+      return it->second;
+    // false until its children are checked, so a cycle fails
+    seen[n] = false;
+
+    if (n->type < NodeType::ROOT_NODE || n->type > NodeType::NONE ||
+        n->binop_type < BinOpType::PLUS ||
+        n->binop_type > BinOpType::NOT_EQUALS ||
+        n->specialization > Specialization::CHECKED ||
+        !type(n->value_type) || !type(n->value.type) ||
+        array::is_array(n->value.type))
+      return false;
+    if (n->type == NodeType::FUNCTION_BODY) {
+      if (n->function == nullptr || n->function->body != n ||
+          !function(*n->function))
+        return false;
+      owner = n->function;
+    }
+    if (n->slot != -1) {
+      const Function *frame = n->depth == 0   ? &globals
+                              : n->depth == 1 ? owner
+                                              : nullptr;
+      if (n->slot < 0 || frame == nullptr || n->slot >= frame->num_slots)
+        return false;
+    }
+
+    size_t count = n->body.size();
+    if (n->type == NodeType::FUNCTION_CALL) {
+      // the callee is the function's body, a call may be inside it
+      if (count == 0 || n->body.back() == nullptr ||
+          n->body.back()->type != NodeType::FUNCTION_BODY)
+        return false;
+      const Node *callee = n->body.back();
+      count--;
+      if (!seen.contains(callee) && !node(callee, owner))
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (!node(n->body.items[i], owner))
+        return false;
+    }
+    if (!node(n->left, owner) || !node(n->right, owner) ||
+        !node(n->condition, owner))
+      return false;
+    return seen[n] = true;
+  }
+};
+
+} // namespace
+
+uint64_t key(const std::vector<std::shared_ptr<utils::Source>> &sources,
+             const bool optimize) {
+  uint64_t hash = 14695981039346656037ull;
+  const auto mix = [&](const std::string_view bytes) {
+    for (const char c : bytes) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ull;
+    }
+  };
+  mix(optimize ? "optimize;" : "no-optimize;");
+  // sizes separate the files, so moving text from one to the next changes
+  // the key
+  for (const auto &source : sources) {
+    mix(std::to_string(source->size()) + ";");
+    mix({source->data(), source->size()});
+  }
+  return hash;
+}
+
+std::string path(const std::string &filename) {
+  std::filesystem::path path(filename);
+  if (path.extension() == ".langc")
+    return filename + ".langc";
+  return path.replace_extension(".langc").string();
+}
+
+std::unique_ptr<Program> load(const std::string &path, const uint64_t key) {
+  auto data = utils::Source::try_open(path);
+  if (data == nullptr || data->size() < sizeof(Header))
+    return nullptr;
+  Header header{};
+  std::memcpy(&header, data->data(), sizeof(Header));
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != version || header.key != key || header.nodes == 0)
+    return nullptr;
+  const size_t size = sizeof(Header) + header.nodes * sizeof(NodeRecord) +
+                      header.children * sizeof(uint32_t) +
+                      header.functions * sizeof(FunctionRecord) +
+                      header.slots * sizeof(SlotRecord) +
+                      header.literals * sizeof(StringRef) + header.text;
+  if (size != data->size())
+    return nullptr;
+
+  const char *cursor = data->data() + sizeof(Header);
+  const auto *nodes = section<NodeRecord>(cursor, header.nodes);
+  const auto *children = section<uint32_t>(cursor, header.children);
+  const auto *functions = section<FunctionRecord>(cursor, header.functions);
+  const auto *slots = section<SlotRecord>(cursor, header.slots);
+  const auto *literals = section<StringRef>(cursor, header.literals);
+  const std::string_view text(cursor, header.text);
+
+  // a damaged file is treated like a missing one
+  bool valid = true;
+  const auto view = [&](const StringRef ref) {
+    if (ref.offset > text.size() || ref.length > text.size() - ref.offset) {
+      valid = false;
+      return std::string_view{};
+    }
+    return text.substr(ref.offset, ref.length);
+  };
+  const auto in_range = [&](const uint32_t id, const uint32_t count) {
+    valid = valid && (id == none || id < count);
+    return valid && id != none;
+  };
+
+  auto program = std::make_unique<Program>();
+  program->data = data;
+  Arena &arena = program->unit.arena;
+
+  // node 0 is the root, the rest are built in one block
+  auto *memory = static_cast<Node *>(
+      arena.allocate(sizeof(Node) * header.nodes, alignof(Node)));
+  for (uint32_t i = 1; i < header.nodes; i++)
+    new (memory + i) Node(&arena);
+  const auto node_at = [&](const uint32_t id) -> Node * {
+    if (!in_range(id, header.nodes))
+      return nullptr;
+    return id == 0 ? program->unit.root : memory + id;
+  };
+
+  std::vector<Function *> function_table(header.functions);
+  for (auto &function : function_table)
+    function = arena.make<Function>();
+  for (uint32_t i = 0; i < header.functions && valid; i++) {
+    const FunctionRecord &record = functions[i];
+    Function &function = *function_table[i];
+    function.name = view(record.name);
+    function.return_type = record.return_type;
+    function.single_expression = record.single_expression != 0;
+    function.num_slots = record.num_slots;
+    if (record.arguments_begin > header.slots ||
+        record.argument_count > header.slots - record.arguments_begin ||
+        record.slots_begin > header.slots ||
+        record.slot_count > header.slots - record.slots_begin)
+      return nullptr;
+    for (uint32_t s = 0; s < record.argument_count; s++) {
+      const SlotRecord &slot = slots[record.arguments_begin + s];
+      function.arguments.emplace_back(view(slot.name), slot.type);
+    }
+    for (uint32_t s = 0; s < record.slot_count; s++) {
+      const SlotRecord &slot = slots[record.slots_begin + s];
+      function.slot_names.emplace_back(view(slot.name));
+      function.slot_types.push_back(slot.type);
+    }
+    function.body = node_at(record.body);
+  }
+
+  Node **lists = arena.make_array<Node *>(header.children);
+  for (uint32_t i = 0; i < header.children && valid; i++)
+    lists[i] = node_at(children[i]);
+
+  for (uint32_t i = 0; i < header.nodes && valid; i++) {
+    const NodeRecord &record = nodes[i];
+    Node *node = node_at(i);
+    node->left = node_at(record.left);
+    node->right = node_at(record.right);
+    node->condition = node_at(record.condition);
+    if (record.body_begin > header.children ||
+        record.body_count > header.children - record.body_begin)
+      return nullptr;
+    node->body.items = lists + record.body_begin;
+    node->body.count = node->body.capacity = record.body_count;
+    node->value = record.value;
+    if (record.value.type == STRING) {
+      if (record.value.handle >= header.literals)
+        return nullptr;
+      node->value = Value::string(view(literals[record.value.handle]));
+    }
+    node->value_type = static_cast<Type>(record.value_type);
+    node->type = static_cast<NodeType>(record.type);
+    node->binop_type = static_cast<BinOpType>(record.binop_type);
+    node->specialization = static_cast<Specialization>(record.specialization);
+    node->name = view(record.name);
+    node->depth = record.depth;
+    node->slot = record.slot;
+    node->expression = record.expression;
+    node->parallel = record.parallel;
+    node->function = in_range(record.function, header.functions)
+                         ? function_table[record.function]
+                         : nullptr;
+  }
+  if (!valid)
+    return nullptr;
+
+  const Node *root = program->unit.root;
+  if (root->type != NodeType::ROOT_NODE || root->function == nullptr ||
+      !Validator::function(*root->function))
+    return nullptr;
+  Validator validator{*root->function, {}};
+  if (!validator.node(root, root->function))
+    return nullptr;
+  return program;
+}
+
+bool save(const std::string &path, const uint64_t key, const Node *root) {
+  Writer writer;
+  writer.add(root);
+
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.key = key;
+  header.nodes = static_cast<uint32_t>(writer.nodes.size());
+  header.children = static_cast<uint32_t>(writer.children.size());
+  header.functions = static_cast<uint32_t>(writer.functions.size());
+  header.slots = static_cast<uint32_t>(writer.slots.size());
+  header.literals = static_cast<uint32_t>(writer.literals.size());
+  header.text = static_cast<uint32_t>(writer.text.size());
+
+  const std::string temporary = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    write(out, writer.nodes);
+    write(out, writer.children);
+    write(out, writer.functions);
+    write(out, writer.slots);
+    write(out, writer.literals);
+    out.write(writer.text.data(),
+              static_cast<std::streamsize>(writer.text.size()));
+    if (!out) {
+      out.close();
+      std::error_code error;
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+} // namespace cache
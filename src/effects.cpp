@@ -0,0 +1,80 @@
+#include <effects.hpp>
+
+#include <algorithm>
+
+namespace effects {
+
+bool Analysis::pure(const Function *function) {
+  if (const auto it = known.find(function); it != known.end())
+    return it->second;
+  const bool outermost = checking++ == 0;
+  known[function] = true;
+  const bool result = known[function] = effect_free(function->body);
+  checking--;
+  if (result)
+    assumed.push_back(function);
+  if (outermost) {
+    // an effect found under the assumption is still an effect, but what
+    // was found pure may rest on a function that turned out not to be
+    if (!result) {
+      for (const Function *f : assumed)
+        known.erase(f);
+    }
+    assumed.clear();
+  }
+  return result;
+}
+
+bool Analysis::effect_free(const Node *node) {
+  if (node == nullptr)
+    return true;
+  switch (node->type) {
+  case NodeType::PRINT:
+  case NodeType::ELEMENT_ASSIGNMENT:
+    return false;
+  case NodeType::FUNCTION_CALL:
+    for (const auto &n : node->body) {
+      if (n->type != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      if (!effect_free(n))
+        return false;
+    }
+    return pure(node->function);
+  case NodeType::BINOP:
+    if (node->binop_type == BinOpType::ASSIGNMENT && node->left->depth == 0)
+      return false;
+    break;
+  default:
+    break;
+  }
+  return effect_free(node->left) && effect_free(node->right) &&
+         effect_free(node->condition) &&
+         std::ranges::all_of(node->body,
+                             [&](const Node *n) { return effect_free(n); });
+}
+
+void Analysis::globals_read(const Node *node, std::unordered_set<int> &read,
+                            std::unordered_set<const Function *> &seen) {
+  if (node == nullptr)
+    return;
+  if (node->type == NodeType::IDENTIFIER && node->depth == 0 &&
+      node->slot >= 0 && node->body.empty())
+    read.insert(node->slot);
+  if (node->type == NodeType::FUNCTION_CALL) {
+    for (const auto &n : node->body) {
+      if (n->type != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      globals_read(n, read, seen);
+    }
+    if (seen.insert(node->function).second)
+      globals_read(node->function->body, read, seen);
+    return;
+  }
+  globals_read(node->left, read, seen);
+  globals_read(node->right, read, seen);
+  globals_read(node->condition, read, seen);
+  for (const auto &n : node->body)
+    globals_read(n, read, seen);
+}
+
+} // namespace effects
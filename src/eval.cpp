@@ -1,233 +1,335 @@
-#include "lexer.hpp"
-
-#include <any>
+#include <algorithm>
+#include <charconv>
 #include <memory>
 #include <print>
 #include <string>
+#include <utility>
 
+#include <error.hpp>
 #include <eval.hpp>
-#include <ranges>
+#include <jit.hpp>
+#include <lexer.hpp>
+#include <memo.hpp>
+#include <parallel.hpp>
+#include <profile.hpp>
 
-bool is_numeric(const std::any &x) {
-  return x.type() == typeid(int) || x.type() == typeid(float) ||
-         x.type() == typeid(char);
+bool is_numeric(const Value &x) {
+  return x.type == INT || x.type == FLOAT || x.type == CHAR;
 }
 
-bool is_string(const std::any &x) {
-  return x.type() == typeid(std::string) || x.type() == typeid(std::wstring) ||
-         x.type() == typeid(const char *) || x.type() == typeid(char *) ||
-         x.type() == typeid(wchar_t *);
-}
+bool is_string(const Value &x) { return x.type == STRING; }
 
-bool try_eval(const std::any &x, const std::any &y) {
+bool try_eval(const Value &x, const Value &y) {
   return (is_numeric(x) && is_numeric(y)) || (is_string(x) && is_string(y));
 }
 
-std::any eval_numeric(const std::any &x, const std::any &y,
-                      const BinOpType op) {
-  std::any result;
-  if (x.type() == typeid(int) && y.type() == typeid(int))
-    return eval_numeric_op(std::any_cast<int>(x), std::any_cast<int>(y), op);
-  if (x.type() == typeid(int) && y.type() == typeid(float))
-    return eval_numeric_op(std::any_cast<int>(x), std::any_cast<float>(y), op);
-  if (x.type() == typeid(float) && y.type() == typeid(int))
-    return eval_numeric_op(std::any_cast<float>(x), std::any_cast<int>(y), op);
-  if (x.type() == typeid(float) && y.type() == typeid(float))
-    return eval_numeric_op(std::any_cast<float>(x), std::any_cast<float>(y),
-                           op);
-  if (x.type() == typeid(char) && y.type() == typeid(int))
-    return eval_numeric_op(std::any_cast<char>(x), std::any_cast<int>(y), op);
-  if (x.type() == typeid(int) && y.type() == typeid(char))
-    return eval_numeric_op(std::any_cast<int>(x), std::any_cast<char>(y), op);
-  if (x.type() == typeid(char) && y.type() == typeid(float))
-    return eval_numeric_op(std::any_cast<char>(x), std::any_cast<float>(y),
-                           op);
-  if (x.type() == typeid(float) && y.type() == typeid(char))
-    return eval_numeric_op(std::any_cast<float>(x), std::any_cast<char>(y),
-                           op);
-  if (x.type() == typeid(bool) && y.type() == typeid(bool))
-    return eval_numeric_op(std::any_cast<bool>(x), std::any_cast<bool>(y), op);
-  if (x.type() == typeid(bool) && y.type() == typeid(int))
-    return eval_numeric_op(std::any_cast<bool>(x), std::any_cast<int>(y), op);
-  if (x.type() == typeid(int) && y.type() == typeid(bool))
-    return eval_numeric_op(std::any_cast<int>(x), std::any_cast<bool>(y), op);
-  return result;
+void type_mismatch(const Type expected, const Type got) {
+  throw Error(std::format("type error: expected {}, got {}",
+                          TypeNames[expected], TypeNames[got]));
 }
 
-std::any eval_binop(const std::any &x, const std::any &y, BinOpType op) {
-  std::any result;
-  if (is_numeric(x)) {
-    result = eval_numeric(x, y, op);
-  } else if (x.type() == typeid(std::string)) {
-    result = std::any_cast<std::string>(x) + std::any_cast<std::string>(y);
+void division_by_zero() {
+  throw Error("division by zero");
+}
+
+void print_value(const Value &x) {
+  if (x.type == INT) {
+    std::println("{}", x.i);
+  } else if (x.type == FLOAT) {
+    std::println("{}", x.f);
+  } else if (x.type == CHAR) {
+    std::println("{}", x.c);
+  } else if (x.type == STRING) {
+    std::println("{}", x.str());
   }
+}
 
-  return result;
+static Value &slot(const Node &node) {
+  return node.depth == 0 ? State::globals[node.slot] : State::frame[node.slot];
 }
 
-void print_any(std::any x) {
-  if (x.type() == typeid(int)) {
-    std::println("{}", std::any_cast<int>(x));
-  } else if (x.type() == typeid(double)) {
-    std::println("{}", std::any_cast<double>(x));
-  } else if (x.type() == typeid(char)) {
-    std::println("{}", std::any_cast<char>(x));
-  } else if (x.type() == typeid(std::string)) {
-    std::println("{}", std::any_cast<std::string>(x));
+static const Value *lookup(const std::string &name) {
+  if (State::function != State::global_scope) {
+    const auto &names = State::function->slot_names;
+    for (size_t i = names.size(); i-- > 0;) {
+      if (names[i] == name)
+        return &State::frame[i];
+    }
+  }
+  const auto &names = State::global_scope->slot_names;
+  for (size_t i = names.size(); i-- > 0;) {
+    if (names[i] == name)
+      return &State::globals[i];
   }
+  return nullptr;
 }
 
-std::string interpolate_string(std::string literal) {
-  std::string str;
+std::vector<Segment> split_interpolation(const std::string_view literal) {
+  std::vector<Segment> segments(1);
 
-  for (int i = 0; i < literal.size(); i++) {
+  for (size_t i = 0; i < literal.size(); i++) {
     char c = literal[i];
     if (c == '$') {
       std::string var_name;
-      c = literal[++i];
-      lexer::Token tt;
-      std::string tstr = {c};
-      while (c != ' ' && c != '\\' && c != '\n'&& c != '\0' && i < literal.size() && !lexer::Lexer::any_token(tstr, tt)) {
+      c = ++i < literal.size() ? literal[i] : '\0';
+      while (c != ' ' && c != '\\' && c != '\n' && c != '\0' &&
+             !lexer::Lexer::is_token_char(c)) {
         var_name += c;
-        c = literal[++i];
-        tstr = {c};
-      }
-      std::any value;
-      if (State::vars.contains(var_name)) {
-        value = eval(State::vars[var_name]);
-      } else if (State::scope_variables.contains(var_name)) {
-        value = eval(State::scope_variables[var_name]);
-      }
-
-      if (value.type() == typeid(int)) {
-        str += std::format("{}", std::any_cast<int>(value));
-      }
-      if (value.type() == typeid(float)) {
-        str += std::format("{}", std::any_cast<float>(value));
+        c = ++i < literal.size() ? literal[i] : '\0';
       }
+      segments.push_back({var_name, true});
+      segments.emplace_back();
       if (c != '\0')
-        str += c;
+        segments.back().text += c;
       continue;
     }
-    str += c;
+    segments.back().text += c;
   }
-  return str;
+  std::erase_if(segments, [](const Segment &segment) {
+    return !segment.variable && segment.text.empty();
+  });
+  return segments;
+}
+
+const std::vector<Segment> &interpolation_segments(const Value &str) {
+  return Value::strings->segments(str.handle, split_interpolation);
+}
+
+void format_value(std::string &out, const Value &x) {
+  char buffer[32];
+  std::to_chars_result result{};
+  if (x.type == INT) {
+    result = std::to_chars(buffer, buffer + sizeof(buffer), x.i);
+  } else if (x.type == FLOAT) {
+    result = std::to_chars(buffer, buffer + sizeof(buffer), x.f);
+  } else if (array::is_array(x.type)) {
+    const array::Array &a = array::get(x);
+    out += '[';
+    for (uint32_t i = 0; i < a.size; i++) {
+      if (i != 0)
+        out += ", ";
+      if (a.type == INT_ARRAY)
+        format_value(out, a.ints()[i]);
+      else
+        format_value(out, a.floats()[i]);
+    }
+    out += ']';
+    return;
+  } else {
+    return;
+  }
+  out.append(buffer, result.ptr);
+}
+
+void interpolate(std::string &out, const Value &str) {
+  for (const auto &segment : interpolation_segments(str)) {
+    if (!segment.variable)
+      out += segment.text;
+    else if (const Value *v = lookup(segment.text))
+      format_value(out, *v);
+  }
+}
+
+void write_line(std::string &line) {
+  State::output->write_line(line);
+  line.clear();
+}
+
+// x op y, then the temporaries among them are freed; out of line to keep
+// eval small
+[[gnu::noinline]] static Value consume(const Node *node, const Value &x,
+                                       const Value &y) {
+  const Value result = eval_binop(x, y, node->binop_type, node->specialization);
+  array::release(node->releases, x, y);
+  return result;
 }
 
-std::any eval(const std::shared_ptr<Node> &node) {
-  std::any ret_value;
+Value eval(const Node *node) {
+  if (profile::enabled)
+    profile::count(node->type);
+  Value ret_value;
   switch (node->type) {
-  case NodeType::ROOT_NODE:
+  case NodeType::ROOT_NODE: {
+    State::globals = State::stack.push(node->function->num_slots);
+    std::fill_n(State::globals, node->function->num_slots, 0);
+    State::frame = State::globals;
+    State::global_scope = State::function = node->function;
+    const profile::Call profiled(node->function);
     for (const auto &n : node->body)
       eval(n);
     break;
+  }
   case NodeType::FUNCTION_CALL: {
-    auto prev_vars = State::scope_variables;
-    State::scope_variables.clear();
-    int arg_count = node->function.arguments.size();
+    const Node *callee = node->body.back();
+    const Function &function = *callee->function;
+    const size_t arg_count = function.arguments.size();
+    // frame layout: [return slot][arguments][locals]
+    Value *base = State::stack.push(function.num_slots + 1);
+    State::stack.guard();
     size_t count = 0;
-    auto n = node->body.begin();
-    for (const auto &name : node->function.arguments | std::views::keys) {
-      if (count >= arg_count || (*n)->type != NodeType::FUNCTION_CALL_PARAM)
+    for (const auto &n : node->body) {
+      if (count >= arg_count || n->type != NodeType::FUNCTION_CALL_PARAM)
         break;
-      State::scope_variables[name] = std::make_shared<Node>();
-      State::scope_variables[name]->value = eval((*n)->body.front());
-      State::scope_variables[name]->type = NodeType::IDENTIFIER;
-      State::scope_variables[name]->name = name;
-      std::advance(n, 1);
-      count++;
+      base[1 + count++] =
+          convert(eval(n->body.front()), n->specialization, n->value_type);
     }
 
     if (count != arg_count) {
-      std::println("[ERROR] when calling function {}: parameter count missmatch", node->function.name);
-      exit(1);
+      throw Error(std::format(
+          "when calling function {}: parameter count missmatch",
+          function.name));
     }
+    std::fill(base + 1 + arg_count, base + 1 + function.num_slots, 0);
 
-    ret_value = eval(*n);
+    // the body may assign its arguments, the key is taken before it runs
+    std::optional<memo::Arguments> key;
+    if (function.memo != nullptr) {
+      key = memo::arguments(function, base + 1);
+      if (const auto cached = memo::find(function, *key)) {
+        State::stack.pop(base);
+        return *cached;
+      }
+    }
 
-    State::scope_variables = prev_vars;
+    if (const profile::Call profiled(&function);
+        const jit::Code code = jit::enabled ? jit::enter(function) : nullptr) {
+      code(base + 1, base);
+    } else {
+      Value *caller_frame = std::exchange(State::frame, base + 1);
+      const Function *caller = std::exchange(State::function, &function);
+      eval(callee);
+      array::release_locals(function, State::frame);
+      State::function = caller;
+      State::frame = caller_frame;
+    }
+    ret_value = base[0];
+    State::stack.pop(base);
+    if (key.has_value())
+      memo::insert(function, *key, ret_value);
 
     //if (ret_value.has_value())
-    //  print_any(ret_value);
+    //  print_value(ret_value);
     return ret_value;
   } break;
   case NodeType::BINOP:
     switch (node->binop_type) {
-    case BinOpType::ASSIGNMENT:
-      node->left->value = eval(node->right);
-      return node->left->value;
+    case BinOpType::ASSIGNMENT: {
+      const Value value =
+          convert(eval(node->right), node->specialization, node->value_type);
+      Value &target = slot(*node->left);
+      if (node->releases != 0)
+        array::release(target);
+      return target = value;
+    }
     default:
-      return eval_binop(eval(node->left), eval(node->right), node->binop_type);
+      if (node->releases != 0)
+        return consume(node, eval(node->left), eval(node->right));
+      return eval_binop(eval(node->left), eval(node->right), node->binop_type,
+                        node->specialization);
     }
-  case NodeType::FUNCTION_BODY:
+  case NodeType::FUNCTION_BODY: {
+    Value &result = State::frame[-1];
+    result.reset();
     for (auto &n : node->body) {
-      ret_value = eval(n);
+      result = eval(n);
       if (n->type == NodeType::RETURN)
         break;
     }
-    if (node->function.return_type == VOID)
-      ret_value.reset();
-    return ret_value;
+    if (node->function->return_type == VOID)
+      result.reset();
+    return result;
+  }
 
   case NodeType::LOOP_BODY:
     for (auto &n : node->body) {
       ret_value = eval(n);
     }
-    if (node->function.return_type == VOID)
-      ret_value.reset();
     return ret_value;
   case NodeType::VARIABLE_DECLARATION:
     for (const auto &n : node->body)
-      node->value = eval(n);
+      eval(n);
     break;
   case NodeType::LITERAL:
-    if (node->value.type() == typeid(int))
-      return std::any_cast<int>(node->value);
-    if (node->value.type() == typeid(float))
-      return std::any_cast<float>(node->value);
-    if (node->value.type() == typeid(std::string))
-      return std::any_cast<std::string>(node->value);
+    return node->value;
   case NodeType::RETURN:
+    ret_value = node->value;
     for (const auto &n : node->body)
-      node->value = eval(n);
-    return node->value;
+      ret_value = eval(n);
+    return ret_value;
   case NodeType::IDENTIFIER:
-    if (State::scope_variables.contains(node->name)) {
-      node->value = State::scope_variables[node->name]->value;
-      return State::scope_variables[node->name]->value;
-    }
-    if (State::vars.contains(node->name)) {
-      node->value = State::vars[node->name]->value;
-      return State::vars[node->name]->value;
-    }
+    if (node->slot >= 0)
+      return slot(*node);
   case NodeType::EXPRESSION:
     for (const auto &n : node->body)
       return eval(n);
     break;
-  case NodeType::PRINT:
+  case NodeType::PRINT: {
+    static thread_local std::string line;
     for (const auto &arg : node->body) {
       if (arg->type == NodeType::LITERAL) {
-
-        auto literal = std::any_cast<std::string>(arg->value);
-        std::println("{}", interpolate_string(literal));
-      }
-      else if (arg->type == NodeType::IDENTIFIER) {
-        std::string literal = std::any_cast<std::string>(
-                      std::any_cast<std::shared_ptr<Node>>(arg->value)->value);
-        std::println(
-            "{}", interpolate_string(literal));
+        // segments were split at parse time and bound by the resolver
+        for (const auto &segment : arg->body) {
+          if (segment->type == NodeType::LITERAL)
+            line += segment->value.str();
+          else if (segment->slot >= 0)
+            format_value(line, slot(*segment));
+        }
+      } else if (arg->type == NodeType::IDENTIFIER) {
+        const Value literal = eval(arg);
+        if (!is_string(literal))
+          continue;
+        interpolate(line, literal);
+      } else {
+        continue;
       }
+      write_line(line);
     }
     break;
+  }
 
+  case NodeType::ARRAY: {
+    if (node->condition != nullptr)
+      return array::allocate(node->value_type, eval(node->condition));
+    std::vector<Value> elements;
+    elements.reserve(node->body.size());
+    for (const auto &n : node->body)
+      elements.push_back(eval(n));
+    return array::literal(node->value_type, elements);
+  }
+  case NodeType::INDEX: {
+    const Value target = eval(node->left);
+    const Value element = array::load(target, eval(node->right));
+    array::release(node->releases, target);
+    return element;
+  }
+  case NodeType::ELEMENT_ASSIGNMENT: {
+    const Value target = eval(node->left->left);
+    const Value index = eval(node->left->right);
+    const Value value =
+        convert(eval(node->right), node->specialization, node->value_type);
+    array::store(target, index, value);
+    return value;
+  }
+  case NodeType::LENGTH: {
+    const Value target = eval(node->body.front());
+    ret_value = array::length(target);
+    array::release(node->releases, target);
+    return ret_value;
+  }
+  case NodeType::REDUCTION: {
+    const Value target = eval(node->body.front());
+    ret_value = array::reduce(target, node->binop_type);
+    array::release(node->releases, target);
+    return ret_value;
+  }
   case NodeType::LOOP_DECLARATION: {
-    int loops = std::any_cast<int>(eval(node->condition));
-    State::scope_variables["_index"];
-    State::scope_variables["_index"] = std::make_shared<Node>();
-    State::scope_variables["_index"]->type = NodeType::LITERAL;
-    State::scope_variables["_index"]->name = "_index";
+    const int loops = eval(node->condition).to_int();
+    if (node->parallel) {
+      if (const auto result = parallel::run(node, loops))
+        return *result;
+    }
     for (int i = 0; i < loops; i++) {
-      State::scope_variables["_index"]->value = i;
+      slot(*node) = i;
       ret_value = eval(node->body.front());
     }
     return ret_value;
@@ -0,0 +1,305 @@
+#include <flat_ast.hpp>
+
+#include <algorithm>
+#include <error.hpp>
+#include <eval.hpp>
+#include <jit.hpp>
+#include <memo.hpp>
+#include <profile.hpp>
+#include <print>
+#include <unordered_map>
+#include <utility>
+
+namespace flat {
+
+namespace {
+
+struct Flattener {
+  Ast ast;
+  std::unordered_map<const Node *, NodeId> ids;
+  std::unordered_map<const Function *, uint32_t> function_ids;
+
+  uint32_t add_function(const Function *function) {
+    if (function == nullptr)
+      return none;
+    if (const auto it = function_ids.find(function); it != function_ids.end())
+      return it->second;
+    ast.function_table.push_back(*function);
+    return function_ids[function] =
+               static_cast<uint32_t>(ast.function_table.size() - 1);
+  }
+
+  NodeId add(const Node *node) {
+    if (node == nullptr)
+      return none;
+    if (const auto it = ids.find(node); it != ids.end())
+      return it->second;
+
+    const auto id = static_cast<NodeId>(ast.size());
+    ids[node] = id;
+    ast.kinds.push_back(node->type);
+    ast.binops.push_back(node->binop_type);
+    ast.specializations.push_back(node->specialization);
+    ast.value_types.push_back(node->value_type);
+    ast.values.push_back(node->value);
+    ast.depths.push_back(static_cast<int8_t>(node->depth));
+    ast.slots.push_back(node->slot);
+    ast.names.push_back(node->name);
+    ast.releases.push_back(node->releases);
+    ast.functions.push_back(add_function(node->function));
+    ast.left.push_back(none);
+    ast.right.push_back(none);
+    ast.child_begin.push_back(0);
+    ast.child_count.push_back(0);
+
+    std::vector<NodeId> children;
+    children.reserve(node->body.size());
+    for (const auto &n : node->body)
+      children.push_back(add(n));
+    ast.child_begin[id] = static_cast<uint32_t>(ast.child_list.size());
+    ast.child_count[id] = static_cast<uint32_t>(children.size());
+    ast.child_list.insert(ast.child_list.end(), children.begin(),
+                          children.end());
+
+    const NodeId left = add(node->condition != nullptr ? node->condition
+                                                       : node->left);
+    const NodeId right = add(node->right);
+    ast.left[id] = left;
+    ast.right[id] = right;
+    return id;
+  }
+};
+
+Value &slot(const Ast &ast, const NodeId id) {
+  return ast.depths[id] == 0 ? State::globals[ast.slots[id]]
+                             : State::frame[ast.slots[id]];
+}
+
+// x op y, then the temporaries among them are freed; out of line to keep
+// eval small
+[[gnu::noinline]] Value consume(const Ast &ast, const NodeId id, const Value &x,
+              const Value &y) {
+  const Value result =
+      eval_binop(x, y, ast.binops[id], ast.specializations[id]);
+  array::release(ast.releases[id], x, y);
+  return result;
+}
+
+} // namespace
+
+Ast flatten(const Node *root) {
+  Flattener flattener;
+  flattener.ast.root = flattener.add(root);
+  return std::move(flattener.ast);
+}
+
+Value eval(const Ast &ast, const NodeId id) {
+  if (profile::enabled)
+    profile::count(ast.kinds[id]);
+  Value ret_value;
+  const auto children = ast.children(id);
+  switch (ast.kinds[id]) {
+  case NodeType::ROOT_NODE: {
+    const Function &function = ast.function(id);
+    State::globals = State::stack.push(function.num_slots);
+    std::fill_n(State::globals, function.num_slots, 0);
+    State::frame = State::globals;
+    State::global_scope = State::function = &function;
+    const profile::Call profiled(&function);
+    for (const NodeId n : children)
+      eval(ast, n);
+    break;
+  }
+  case NodeType::FUNCTION_CALL: {
+    const NodeId callee = children.back();
+    const Function &function = ast.function(callee);
+    const size_t arg_count = function.arguments.size();
+    Value *base = State::stack.push(function.num_slots + 1);
+    State::stack.guard();
+    size_t count = 0;
+    for (const NodeId n : children) {
+      if (count >= arg_count || ast.kinds[n] != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      base[1 + count++] = convert(eval(ast, ast.children(n).front()),
+                                  ast.specializations[n], ast.value_types[n]);
+    }
+
+    if (count != arg_count) {
+      throw Error(std::format(
+          "when calling function {}: parameter count missmatch",
+          function.name));
+    }
+    std::fill(base + 1 + arg_count, base + 1 + function.num_slots, 0);
+
+    // the body may assign its arguments, the key is taken before it runs
+    std::optional<memo::Arguments> key;
+    if (function.memo != nullptr) {
+      key = memo::arguments(function, base + 1);
+      if (const auto cached = memo::find(function, *key)) {
+        State::stack.pop(base);
+        return *cached;
+      }
+    }
+
+    if (const profile::Call profiled(&function);
+        const jit::Code code = jit::enabled ? jit::enter(function) : nullptr) {
+      code(base + 1, base);
+    } else {
+      Value *caller_frame = std::exchange(State::frame, base + 1);
+      const Function *caller = std::exchange(State::function, &function);
+      eval(ast, callee);
+      array::release_locals(function, State::frame);
+      State::function = caller;
+      State::frame = caller_frame;
+    }
+    ret_value = base[0];
+    State::stack.pop(base);
+    if (key.has_value())
+      memo::insert(function, *key, ret_value);
+    return ret_value;
+  }
+  case NodeType::BINOP:
+    if (ast.binops[id] == BinOpType::ASSIGNMENT) {
+      const Value value = convert(eval(ast, ast.right[id]),
+                                  ast.specializations[id], ast.value_types[id]);
+      Value &target = slot(ast, ast.left[id]);
+      if (ast.releases[id] != 0)
+        array::release(target);
+      return target = value;
+    }
+    if (ast.releases[id] != 0)
+      return consume(ast, id, eval(ast, ast.left[id]),
+                     eval(ast, ast.right[id]));
+    return eval_binop(eval(ast, ast.left[id]), eval(ast, ast.right[id]),
+                      ast.binops[id], ast.specializations[id]);
+  case NodeType::FUNCTION_BODY: {
+    Value &result = State::frame[-1];
+    result.reset();
+    for (const NodeId n : children) {
+      result = eval(ast, n);
+      if (ast.kinds[n] == NodeType::RETURN)
+        break;
+    }
+    if (ast.function(id).return_type == VOID)
+      result.reset();
+    return result;
+  }
+  case NodeType::LOOP_BODY:
+    for (const NodeId n : children)
+      ret_value = eval(ast, n);
+    return ret_value;
+  case NodeType::VARIABLE_DECLARATION:
+    for (const NodeId n : children)
+      eval(ast, n);
+    break;
+  case NodeType::LITERAL:
+    return ast.values[id];
+  case NodeType::RETURN:
+    ret_value = ast.values[id];
+    for (const NodeId n : children)
+      ret_value = eval(ast, n);
+    return ret_value;
+  case NodeType::IDENTIFIER:
+    if (ast.slots[id] >= 0)
+      return slot(ast, id);
+  case NodeType::EXPRESSION:
+    if (!children.empty())
+      return eval(ast, children.front());
+    break;
+  case NodeType::PRINT: {
+    static thread_local std::string line;
+    for (const NodeId arg : children) {
+      if (ast.kinds[arg] == NodeType::LITERAL) {
+        for (const NodeId segment : ast.children(arg)) {
+          if (ast.kinds[segment] == NodeType::LITERAL)
+            line += ast.values[segment].str();
+          else if (ast.slots[segment] >= 0)
+            format_value(line, slot(ast, segment));
+        }
+      } else if (ast.kinds[arg] == NodeType::IDENTIFIER) {
+        const Value literal = eval(ast, arg);
+        if (!is_string(literal))
+          continue;
+        interpolate(line, literal);
+      } else {
+        continue;
+      }
+      write_line(line);
+    }
+    break;
+  }
+  case NodeType::ARRAY: {
+    if (ast.left[id] != none)
+      return array::allocate(ast.value_types[id], eval(ast, ast.left[id]));
+    std::vector<Value> elements;
+    elements.reserve(children.size());
+    for (const NodeId n : children)
+      elements.push_back(eval(ast, n));
+    return array::literal(ast.value_types[id], elements);
+  }
+  case NodeType::INDEX: {
+    const Value target = eval(ast, ast.left[id]);
+    const Value element = array::load(target, eval(ast, ast.right[id]));
+    array::release(ast.releases[id], target);
+    return element;
+  }
+  case NodeType::ELEMENT_ASSIGNMENT: {
+    const NodeId index = ast.left[id];
+    const Value target = eval(ast, ast.left[index]);
+    const Value position = eval(ast, ast.right[index]);
+    const Value value = convert(eval(ast, ast.right[id]),
+                                ast.specializations[id], ast.value_types[id]);
+    array::store(target, position, value);
+    return value;
+  }
+  case NodeType::LENGTH: {
+    const Value target = eval(ast, children.front());
+    ret_value = array::length(target);
+    array::release(ast.releases[id], target);
+    return ret_value;
+  }
+  case NodeType::REDUCTION: {
+    const Value target = eval(ast, children.front());
+    ret_value = array::reduce(target, ast.binops[id]);
+    array::release(ast.releases[id], target);
+    return ret_value;
+  }
+  case NodeType::LOOP_DECLARATION: {
+    const int loops = eval(ast, ast.left[id]).to_int();
+    const NodeId body = children.front();
+    for (int i = 0; i < loops; i++) {
+      slot(ast, id) = i;
+      ret_value = eval(ast, body);
+    }
+    return ret_value;
+  }
+  default:
+    break;
+  }
+  return 0;
+}
+
+void run(const Ast &ast) { eval(ast, ast.root); }
+
+void dump(const Ast &ast) {
+  for (NodeId id = 0; id < ast.size(); id++) {
+    std::print("{:5} {:<21}", id,
+               NodeTypeNames[static_cast<int>(ast.kinds[id])]);
+    if (!ast.names[id].empty())
+      std::print(" '{}'", ast.names[id]);
+    if (ast.slots[id] >= 0)
+      std::print(" slot {}:{}", ast.depths[id], ast.slots[id]);
+    if (ast.left[id] != none)
+      std::print(" left {}", ast.left[id]);
+    if (ast.right[id] != none)
+      std::print(" right {}", ast.right[id]);
+    if (ast.child_count[id] != 0) {
+      std::print(" children");
+      for (const NodeId n : ast.children(id))
+        std::print(" {}", n);
+    }
+    std::println("");
+  }
+}
+
+} // namespace flat
@@ -0,0 +1,171 @@
+#include <interpreter.hpp>
+
+#include <error.hpp>
+#include <eval.hpp>
+#include <format>
+#include <jit.hpp>
+#include <optimizer.hpp>
+#include <profile.hpp>
+#include <resolver.hpp>
+#include <typecheck.hpp>
+#include <utility>
+#include <vm.hpp>
+
+namespace {
+
+// points the thread's runtime state at an instance, the previous state is
+// put back when it goes out of scope, also when an error unwinds a run, so
+// instances can take turns on one thread
+class Switch {
+public:
+  Switch(Output *output, const parallel::Context context, array::Heap *heap,
+         Strings *strings, const bool jit, const bool profile)
+      : output(std::exchange(State::output, output)),
+        context(std::exchange(parallel::context, context)),
+        heap(std::exchange(array::heap, heap)),
+        strings(std::exchange(Value::strings, strings)),
+        jit(std::exchange(jit::enabled, jit)),
+        profile(std::exchange(profile::enabled, profile)) {}
+  Switch(const Switch &) = delete;
+  Switch &operator=(const Switch &) = delete;
+
+  ~Switch() {
+    State::output = output;
+    parallel::context = context;
+    array::heap = heap;
+    Value::strings = strings;
+    jit::enabled = jit;
+    profile::enabled = profile;
+    State::globals = globals;
+    State::frame = frame;
+    State::function = function;
+    State::global_scope = global_scope;
+    State::stack.pop(top != nullptr ? top : State::stack.slots);
+  }
+
+private:
+  Output *output;
+  parallel::Context context;
+  array::Heap *heap;
+  Strings *strings;
+  bool jit;
+  bool profile;
+  Value *globals = State::globals;
+  Value *frame = State::frame;
+  const Function *function = State::function;
+  const Function *global_scope = State::global_scope;
+  Value *top = State::stack.top;
+};
+
+} // namespace
+
+Interpreter::Interpreter(Options options) : options(std::move(options)) {
+  const std::string &engine = this->options.engine;
+  if (engine != "tree" && engine != "vm" && engine != "flat")
+    throw Error(std::format(
+        "unknown engine '{}', expected 'tree', 'vm' or 'flat'", engine));
+  if (this->options.profile && engine == "vm")
+    throw Error("profiling needs the tree or flat engine");
+  if (this->options.threads > 1)
+    pool = std::make_unique<ThreadPool>(this->options.threads);
+  output.redirect(&printed);
+}
+
+void Interpreter::load(
+    const std::vector<std::shared_ptr<utils::Source>> &sources) {
+  plans.clear();
+  caches.clear();
+  bytecode = {};
+  ast = {};
+  files.clear();
+  unit = std::make_unique<CompilationUnit>();
+  // the previous program's literals go with it
+  strings.release(0);
+  Strings *saved_strings = std::exchange(Value::strings, &strings);
+  try {
+    compile(sources);
+  } catch (...) {
+    // a program that failed to load does not run
+    Value::strings = saved_strings;
+    unit = nullptr;
+    files.clear();
+    throw;
+  }
+  loaded_strings = strings.size();
+  Value::strings = saved_strings;
+}
+
+void Interpreter::compile(
+    const std::vector<std::shared_ptr<utils::Source>> &sources) {
+  if (sources.size() > 1 && pool != nullptr) {
+    files = program::parse_all(sources, *pool);
+  } else {
+    for (const auto &source : sources)
+      files.push_back(program::parse(source, nullptr, false));
+  }
+  Node *root = unit->root;
+  program::link(files, root);
+  resolver::resolve(root);
+  typecheck::check(root);
+  if (options.optimize)
+    optimizer::optimize(root);
+
+  // the name tables are this thread's, they must not point into the program
+  // once it is loaded
+  State::vars.clear();
+  State::functions.clear();
+  State::scope_variables.clear();
+  State::unresolved_calls.clear();
+  State::unresolved_globals.clear();
+
+  plans = parallel::analyze(root);
+  if (pool != nullptr)
+    parallel::warn_sequential(plans, options.engine);
+  if (options.memoize)
+    caches = memo::analyze(root, options.memo_capacity);
+  array::analyze(root);
+  // flattening copies the functions, caches and released slots included
+  if (options.engine == "vm")
+    bytecode = bytecode::compile(root);
+  else if (options.engine == "flat")
+    ast = flat::flatten(root);
+}
+
+void Interpreter::load(std::string source, std::string name) {
+  load({utils::Source::from_string(std::move(source), std::move(name))});
+}
+
+std::string Interpreter::run() {
+  if (unit == nullptr)
+    return {};
+
+  const Switch running(&output, {&plans, pool.get()}, &arrays, &strings,
+                       options.jit, options.profile);
+  if (options.profile)
+    profile::reset();
+  // the run's arrays and strings are freed however it ends
+  const auto release = [&] {
+    output.flush();
+    arrays.clear();
+    strings.release(loaded_strings);
+  };
+  try {
+    if (options.engine == "vm") {
+      vm::run(bytecode);
+    } else {
+      if (options.engine == "flat")
+        flat::run(ast);
+      else
+        eval(unit->root);
+      // the globals stay on the stack once the program ends
+      State::stack.pop(State::globals);
+    }
+  } catch (...) {
+    release();
+    // what a failed run printed is dropped
+    printed.clear();
+    throw;
+  }
+  release();
+  return std::exchange(printed, {});
+}
@@ -0,0 +1,357 @@
+#include <jit.hpp>
+
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace jit {
+
+namespace {
+
+// per thread, like the programs being compiled
+thread_local Stats jit_stats;
+
+#if defined(__x86_64__)
+
+// frame slots are Values: the type tag at +0, the payload at +4; rdi holds
+// the frame, rsi the result. Ints live in eax and floats in xmm0, operands
+// waiting for the other side of a binop are pushed on the machine stack
+struct Assembler {
+  std::vector<uint8_t> code;
+  const Function &function;
+  bool ok = true;
+
+  explicit Assembler(const Function &function) : function(function) {}
+
+  void bytes(const std::initializer_list<uint8_t> b) {
+    code.insert(code.end(), b);
+  }
+
+  void imm32(const int32_t x) {
+    uint8_t b[4];
+    std::memcpy(b, &x, 4);
+    code.insert(code.end(), b, b + 4);
+  }
+
+  static int32_t type_of(const int slot) { return slot * 8; }
+  static int32_t payload_of(const int slot) { return slot * 8 + 4; }
+
+  // op [rdi + disp32] with the given opcode bytes and modrm reg field
+  void frame_op(const std::initializer_list<uint8_t> op, const uint8_t reg,
+                const int32_t disp) {
+    bytes(op);
+    bytes({static_cast<uint8_t>(0x87 | reg << 3)});
+    imm32(disp);
+  }
+
+  void store_type(const int slot, const Type type) {
+    frame_op({0xC7}, 0, type_of(slot)); // mov dword [rdi+d], imm32
+    imm32(type);
+  }
+
+  // stores eax or xmm0 in a frame slot
+  void store(const int slot, const Type type) {
+    store_type(slot, type);
+    if (type == INT)
+      frame_op({0x89}, 0, payload_of(slot)); // mov [rdi+d], eax
+    else
+      frame_op({0xF3, 0x0F, 0x11}, 0, payload_of(slot)); // movss [rdi+d], xmm0
+  }
+
+  // stores eax or xmm0 as the body's value
+  void store_result(const Type type) {
+    bytes({0xC7, 0x06}); // mov dword [rsi], imm32
+    imm32(type);
+    if (type == INT)
+      bytes({0x89, 0x46, 0x04}); // mov [rsi+4], eax
+    else if (type == FLOAT)
+      bytes({0xF3, 0x0F, 0x11, 0x46, 0x04}); // movss [rsi+4], xmm0
+    else
+      bytes({0xC7, 0x46, 0x04, 0, 0, 0, 0}); // mov dword [rsi+4], 0
+  }
+
+  void to_float() { bytes({0xF3, 0x0F, 0x2A, 0xC0}); } // cvtsi2ss xmm0, eax
+  void to_int() { bytes({0xF3, 0x0F, 0x2C, 0xC0}); }   // cvttss2si eax, xmm0
+
+  void push(const Type type) {
+    if (type == FLOAT)
+      bytes({0x66, 0x0F, 0x7E, 0xC0}); // movd eax, xmm0
+    bytes({0x50});                     // push rax
+  }
+
+  [[nodiscard]] bool is_local(const Node *node) const {
+    if (node->depth != 1 || node->slot < 0 || !node->body.empty())
+      return false;
+    const Type type = function.slot_types[node->slot];
+    return type == INT || type == FLOAT;
+  }
+
+  Type fail() {
+    ok = false;
+    return UNKNOWN;
+  }
+
+  Type binop(const Node *node) {
+    Type x = expression(node->left);
+    if (x == INT && node->specialization == Specialization::INT_FLOAT) {
+      to_float();
+      x = FLOAT;
+    }
+    push(x);
+    Type y = expression(node->right);
+    if (y == INT && node->specialization == Specialization::FLOAT_INT) {
+      to_float();
+      y = FLOAT;
+    }
+    if (!ok || x != y)
+      return fail();
+
+    if (x == INT) {
+      bytes({0x89, 0xC1, 0x58}); // mov ecx, eax; pop rax
+      switch (node->binop_type) {
+      case BinOpType::PLUS:
+        bytes({0x01, 0xC8}); // add eax, ecx
+        break;
+      case BinOpType::MINUS:
+        bytes({0x29, 0xC8}); // sub eax, ecx
+        break;
+      case BinOpType::MUL:
+        bytes({0x0F, 0xAF, 0xC1}); // imul eax, ecx
+        break;
+      case BinOpType::DIV:
+        // idiv traps on zero and INT_MIN / -1, other divisors are left to
+        // the interpreter
+        if (node->right->type != NodeType::LITERAL ||
+            node->right->value.i == 0 || node->right->value.i == -1)
+          return fail();
+        bytes({0x99, 0xF7, 0xF9}); // cdq; idiv ecx
+        break;
+      default:
+        return fail();
+      }
+      return INT;
+    }
+
+    // movaps xmm1, xmm0; pop rax; movd xmm0, eax
+    bytes({0x0F, 0x28, 0xC8, 0x58, 0x66, 0x0F, 0x6E, 0xC0});
+    switch (node->binop_type) {
+    case BinOpType::PLUS:
+      bytes({0xF3, 0x0F, 0x58, 0xC1}); // addss xmm0, xmm1
+      break;
+    case BinOpType::MINUS:
+      bytes({0xF3, 0x0F, 0x5C, 0xC1}); // subss xmm0, xmm1
+      break;
+    case BinOpType::MUL:
+      bytes({0xF3, 0x0F, 0x59, 0xC1}); // mulss xmm0, xmm1
+      break;
+    case BinOpType::DIV:
+      bytes({0xF3, 0x0F, 0x5E, 0xC1}); // divss xmm0, xmm1
+      break;
+    default:
+      return fail();
+    }
+    return FLOAT;
+  }
+
+  Type assignment(const Node *node) {
+    if (!is_local(node->left))
+      return fail();
+    Type type = expression(node->right);
+    if (type == INT && node->specialization == Specialization::TO_FLOAT) {
+      to_float();
+      type = FLOAT;
+    }
+    if (!ok || type != function.slot_types[node->left->slot])
+      return fail();
+    store(node->left->slot, type);
+    return type;
+  }
+
+  // leaves the value in eax or xmm0 and returns its type
+  Type expression(const Node *node) {
+    if (!ok)
+      return UNKNOWN;
+    switch (node->type) {
+    case NodeType::LITERAL:
+      if (node->value.type != INT && node->value.type != FLOAT)
+        return fail();
+      bytes({0xB8}); // mov eax, imm32
+      imm32(node->value.i);
+      if (node->value.type == FLOAT)
+        bytes({0x66, 0x0F, 0x6E, 0xC0}); // movd xmm0, eax
+      return node->value.type;
+    case NodeType::IDENTIFIER: {
+      if (!is_local(node))
+        return fail();
+      const Type type = function.slot_types[node->slot];
+      if (type == INT)
+        frame_op({0x8B}, 0, payload_of(node->slot)); // mov eax, [rdi+d]
+      else
+        frame_op({0xF3, 0x0F, 0x10}, 0, payload_of(node->slot)); // movss
+      return type;
+    }
+    case NodeType::EXPRESSION:
+      if (node->body.size() != 1)
+        return fail();
+      return expression(node->body.front());
+    case NodeType::BINOP:
+      if (node->binop_type == BinOpType::ASSIGNMENT)
+        return assignment(node);
+      switch (node->specialization) {
+      case Specialization::INT_INT:
+      case Specialization::FLOAT_FLOAT:
+      case Specialization::INT_FLOAT:
+      case Specialization::FLOAT_INT:
+        return binop(node);
+      default:
+        return fail();
+      }
+    default:
+      return fail();
+    }
+  }
+
+  void loop(const Node *node, const bool keeps_value) {
+    const int index = node->slot;
+    const int count = index + 1;
+    const Type bound = expression(node->condition);
+    if (bound == FLOAT)
+      to_int();
+    else if (bound != INT)
+      fail();
+    store(count, INT);
+    bytes({0x31, 0xC0}); // xor eax, eax
+    store(index, INT);
+    if (keeps_value) {
+      // a loop that never runs has no value
+      store_result(VOID);
+    }
+
+    const size_t top = code.size();
+    frame_op({0x8B}, 0, payload_of(index)); // mov eax, [rdi+index]
+    frame_op({0x3B}, 0, payload_of(count)); // cmp eax, [rdi+count]
+    bytes({0x0F, 0x8D});                    // jge end
+    const size_t exit = code.size();
+    imm32(0);
+
+    block(node->body.front(), keeps_value);
+
+    frame_op({0xFF}, 0, payload_of(index)); // inc dword [rdi+index]
+    bytes({0xE9});                          // jmp top
+    imm32(static_cast<int32_t>(top - (code.size() + 4)));
+    const auto end = static_cast<int32_t>(code.size() - (exit + 4));
+    std::memcpy(code.data() + exit, &end, 4);
+  }
+
+  void statement(const Node *node, const bool keeps_value) {
+    switch (node->type) {
+    case NodeType::IDENTIFIER:
+      if (!is_local(node)) {
+        fail();
+        return;
+      }
+      if (keeps_value) {
+        frame_op({0x48, 0x8B}, 0, type_of(node->slot)); // mov rax, [rdi+d]
+        bytes({0x48, 0x89, 0x06});                      // mov [rsi], rax
+      }
+      return;
+    case NodeType::VARIABLE_DECLARATION:
+      for (const auto &n : node->body) {
+        if (n->type == NodeType::BINOP)
+          expression(n);
+      }
+      if (keeps_value) {
+        bytes({0x31, 0xC0}); // xor eax, eax
+        store_result(INT);
+      }
+      return;
+    case NodeType::LOOP_DECLARATION:
+      loop(node, keeps_value);
+      return;
+    case NodeType::RETURN:
+      if (node->body.size() != 1) {
+        fail();
+        return;
+      }
+    case NodeType::EXPRESSION: {
+      const Type type = expression(node->type == NodeType::RETURN
+                                       ? node->body.front()
+                                       : node);
+      if (keeps_value && ok)
+        store_result(type);
+      return;
+    }
+    default:
+      fail();
+    }
+  }
+
+  // only the statement that gives the block its value stores a result
+  void block(const Node *node, const bool keeps_value) {
+    size_t count = node->body.size();
+    if (node->type == NodeType::FUNCTION_BODY) {
+      for (size_t i = 0; i < count; i++) {
+        if (node->body.items[i]->type == NodeType::RETURN) {
+          count = i + 1;
+          break;
+        }
+      }
+    }
+    if (count == 0 && keeps_value)
+      store_result(VOID);
+    for (size_t i = 0; i < count && ok; i++)
+      statement(node->body.items[i], keeps_value && i + 1 == count);
+  }
+
+  void body() {
+    const bool is_void = function.return_type == VOID;
+    block(function.body, !is_void);
+    if (is_void)
+      store_result(VOID);
+    bytes({0xC3}); // ret
+  }
+};
+
+// the pages holding code, unmapped when the last owner lets go
+std::shared_ptr<void> install(const std::vector<uint8_t> &code) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  const size_t size = (code.size() + page - 1) / page * page;
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return nullptr;
+  std::shared_ptr<void> pages(memory, [size](void *p) { munmap(p, size); });
+  std::memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    return nullptr;
+  return pages;
+}
+
+#endif
+
+} // namespace
+
+Code compile(const Function &function) {
+#if defined(__x86_64__)
+  if (function.body != nullptr) {
+    Assembler assembler(function);
+    assembler.body();
+    if (assembler.ok) {
+      if (auto pages = install(assembler.code)) {
+        jit_stats.compiled++;
+        jit_stats.code_bytes += assembler.code.size();
+        function.code_pages = std::move(pages);
+        return reinterpret_cast<Code>(function.code_pages.get());
+      }
+    }
+  }
+#endif
+  jit_stats.rejected++;
+  return nullptr;
+}
+
+const Stats &stats() { return jit_stats; }
+
+} // namespace jit
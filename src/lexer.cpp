@@ -1,10 +1,9 @@
 #include <lexer.hpp>
 
-#include <any>
-#include <chrono>
-#include <fstream>
+#include <charconv>
 #include <print>
 
+#include <error.hpp>
 #include <utils.hpp>
 
 #include <algorithm>
@@ -15,50 +14,134 @@ namespace lexer {
   return current_token >= parsed_tokens.size();
 }
 
-void Lexer::remove_comments() {
-  for (size_t i = 0; i < file_str.size(); i++) {
-    if (file_str[i] == '/' && file_str[i + 1] == '/') {
-      if (const size_t l = file_str.find('\n', i); l != std::string::npos) {
-        file_str.erase(i, l - i);
-      } else {
-        file_str.erase(i, 2);
-      }
+void Lexer::skip_comment() {
+  const size_t size = file_str.size();
+  if (file_str[curr_pos] == '/') {
+    // the newline is left for the caller, it may end a token
+    const size_t l = file_str.find('\n', curr_pos);
+    const size_t stop = l != std::string_view::npos ? l : size;
+    curr_char += static_cast<int>(stop - curr_pos);
+    curr_pos = stop;
+    return;
+  }
+
+  const int line = curr_line;
+  const int column = curr_char - 1;
+  for (curr_pos++, curr_char++; curr_pos < size; curr_pos++, curr_char++) {
+    if (file_str[curr_pos] == '\n') {
+      curr_line++;
+      curr_char = -1;
+    } else if (file_str[curr_pos] == '*' && curr_pos + 1 < size &&
+               file_str[curr_pos + 1] == '/') {
+      curr_pos += 2;
+      curr_char += 2;
+      return;
     }
   }
+  throw Error(std::format("{}:{}:{}: unterminated block comment",
+                          source->name(), line, column + 1),
+              255);
 }
 
-bool Lexer::any_token(const std::string &str, Token &token) {
-  int i = 0;
-  for (auto &t : tokens) {
-    if (t == str) {
-      token.type = static_cast<TokenType>(i);
-      return true;
+namespace {
+
+// perfect hash over the spellings in lexer::tokens, the seed is searched at
+// compile time so that no two spellings share a bucket
+constexpr size_t table_size = 64;
+
+constexpr size_t token_hash(const std::string_view str, const uint32_t seed) {
+  const uint32_t key = static_cast<uint8_t>(str.front()) << 16 |
+                       static_cast<uint8_t>(str.back()) << 8 |
+                       static_cast<uint8_t>(str.size());
+  return key * seed >> 26;
+}
+
+constexpr uint32_t find_seed() {
+  for (uint32_t seed = 1; seed < 1 << 20; seed++) {
+    std::array<bool, table_size> used{};
+    bool collision = false;
+    for (const auto &t : tokens) {
+      if (t.empty())
+        continue;
+      const size_t h = token_hash(t, seed);
+      collision = collision || used[h];
+      used[h] = true;
     }
-    i++;
+    if (!collision)
+      return seed;
+  }
+  return 0;
+}
+
+constexpr uint32_t seed = find_seed();
+static_assert(seed != 0, "no perfect hash seed for lexer::tokens");
+
+constexpr auto token_table = [] {
+  std::array<TokenType, table_size> table{};
+  table.fill(none);
+  for (size_t i = 0; i < tokens.size(); i++) {
+    if (!tokens[i].empty())
+      table[token_hash(tokens[i], seed)] = static_cast<TokenType>(i);
+  }
+  return table;
+}();
+
+constexpr auto token_chars = [] {
+  std::array<bool, 256> table{};
+  for (const auto &t : tokens) {
+    if (t.size() == 1)
+      table[static_cast<uint8_t>(t.front())] = true;
   }
+  return table;
+}();
+
+} // namespace
 
-  token.type = unknown;
+TokenType Lexer::classify(const std::string_view str) {
+  if (str.empty())
+    return id;
+  const TokenType type = token_table[token_hash(str, seed)];
+  return type != none && tokens[type] == str ? type : unknown;
+}
+
+bool Lexer::is_token_char(const char c) {
+  return token_chars[static_cast<uint8_t>(c)];
+}
 
-  return false;
+bool Lexer::any_token(const std::string_view str, Token &token) {
+  token.type = classify(str);
+  return token.type != unknown;
 }
 
-bool Lexer::is_float(const std::string &str) {
+bool Lexer::is_float(const std::string_view str) {
   if (!str.contains('.'))
     return false;
   return std::ranges::none_of(
       str, [](const char c) { return (c < 48 || c > 57) && c != '.'; });
 }
-bool Lexer::is_int(const std::string &str) {
+bool Lexer::is_int(const std::string_view str) {
   return std::ranges::none_of(str,
                               [](const char c) { return c < 48 || c > 57; });
 }
 
+std::string_view Lexer::text(const Token &t) const {
+  if (t.type == string_literal && t.value.type == STRING)
+    return t.value.str();
+  return file_str.substr(t.offset, t.length);
+}
+
+std::string_view Lexer::text() const {
+  if (current_token >= parsed_tokens.size())
+    return {};
+  return text(parsed_tokens[current_token]);
+}
+
 void Lexer::print_tokens() {
-  std::print("[");
   for (auto &t : parsed_tokens) {
-    std::print("\'{}\' ", t.str);
+    if (t.type != none)
+      std::println("{:15} {:15} {}:{}", text(t), token_names[t.type],
+                   t.line_number, t.char_number + 1);
   }
-  std::println("]");
 }
 void Lexer::move(const int x) { current_token += x; }
 
@@ -81,15 +164,6 @@ void Lexer::advance(size_t x) {
   current_token = std::min(current_token, parsed_tokens.size() - 1);
 }
 
-Lexer Lexer::slice(const size_t beg, const size_t end) {
-  Lexer l;
-  l.parsed_tokens = std::vector<Token>(parsed_tokens.begin() + beg,
-                                       parsed_tokens.begin() + end);
-  l.curr_line = curr_line;
-  l.curr_char = curr_char;
-  return l;
-}
-
 std::optional<size_t> Lexer::find_next(const TokenType t) {
   size_t pos = 1;
   while (current_token + pos <= parsed_tokens.size() - 1) {
@@ -102,34 +176,45 @@ std::optional<size_t> Lexer::find_next(const TokenType t) {
   return std::nullopt;
 }
 
-bool parsing_string = false;
-bool parsing_float = false;
 Token Lexer::next_token() {
   if (curr_pos >= file_str.size())
-    return {"", eof};
-  std::string buff{};
-  Token t, tt;
-  bool line_break = false;
+    return {.type = eof, .line_number = curr_line, .char_number = curr_char};
+  size_t begin = curr_pos;
+  size_t length = 0;
+  Token t;
+  t.line_number = curr_line;
+  t.char_number = curr_char;
   while (curr_pos < file_str.size()) {
     const char c = file_str[curr_pos++];
     curr_char++;
-    if ((c == ' ' || c == '\n') && !buff.empty() && parsing_string == false) {
-      if (c == '\n') {
-        line_break = true;
-      }
-      break;
-    }
-    if (c == ' ' && parsing_string == false) {
+    if (c == '/' && parsing_string == false && curr_pos < file_str.size() &&
+        (file_str[curr_pos] == '/' || file_str[curr_pos] == '*')) {
+      skip_comment();
+      if (length != 0)
+        break;
       continue;
     }
-
-    if (c == '\n' && parsing_string == false) {
-      line_break = true;
+    if (c == '\n') {
+      curr_line++;
+      curr_char = 0;
+    }
+    if ((c == ' ' || c == '\n') && length != 0 && parsing_string == false) {
+      break;
+    }
+    if ((c == ' ' || c == '\n') && parsing_string == false) {
       continue;
     }
     if (c == '\"') {
       if (parsing_string == false) {
+        if (length != 0) {
+          // a quote right after a token starts the next one
+          curr_pos--;
+          curr_char--;
+          break;
+        }
         parsing_string = true;
+        t.line_number = curr_line;
+        t.char_number = curr_char - 1;
         continue;
       }
       parsing_string = false;
@@ -137,53 +222,63 @@ Token Lexer::next_token() {
       break;
     }
     if (curr_pos >= file_str.size())
-      return {"", eof};
-    buff += c;
+      return {.type = eof, .line_number = curr_line, .char_number = curr_char};
+    if (length++ == 0) {
+      begin = curr_pos - 1;
+      if (parsing_string == false) {
+        t.line_number = curr_line;
+        t.char_number = curr_char - 1;
+      }
+    }
+    const std::string_view buff = file_str.substr(begin, length);
 
     if (any_token(buff, t) &&
          file_str.size() > curr_pos &&
-         (file_str[curr_pos] == ' ' ||
-          !any_token(file_str.substr(curr_pos, 1), tt)) ||
-        any_token(file_str.substr(curr_pos, 1), tt)) {
+         (file_str[curr_pos] == ' ' || !is_token_char(file_str[curr_pos])) ||
+        is_token_char(file_str[curr_pos])) {
 
-      if (buff[0] == '-' && file_str[curr_pos + 1] != '>' || parsing_string == true)
+      if (buff[0] == '-' && (curr_pos + 1 >= file_str.size() ||
+                             file_str[curr_pos + 1] != '>') ||
+          parsing_string == true)
         continue;
       break;
     }
   }
 
+  const std::string_view buff = file_str.substr(begin, length);
   if (t.type == unknown) {
     if (is_int(buff)) {
       t.type = int_literal;
-      t.value = static_cast<int>(strtol(buff.c_str(), nullptr, 10));
-      // std::println("{}", buff.c_str() );
-    } else if (is_float(buff))
+      int value = 0;
+      if (std::from_chars(buff.data(), buff.data() + buff.size(), value).ec ==
+          std::errc::result_out_of_range)
+        throw Error(std::format("{}:{}:{}: integer literal out of range",
+                                source->name(), t.line_number,
+                                t.char_number + 1),
+                    255);
+      t.value = value;
+    } else if (is_float(buff)) {
       t.type = float_literal;
-    else
+      float value = 0;
+      std::from_chars(buff.data(), buff.data() + buff.size(), value);
+      t.value = value;
+    } else
       t.type = id;
   }
 
-  t.str = buff;
+  t.offset = static_cast<uint32_t>(begin);
+  t.length = static_cast<uint32_t>(length);
 
-  if (t.str.empty()) {
+  if (length == 0) {
     t.type = none;
   }
 
-  if (t.type == string_literal) {
-    size_t new_line = t.str.find("\\n");
-    while (new_line != std::string::npos) {
-      if (new_line != std::string::npos) {
-        t.str.replace(new_line, 2, "\n");
-      }
-      new_line = t.str.find("\\n");
-    }
-  }
-  t.line_number = curr_line;
-  t.char_number = curr_char - t.str.size();
-  if (line_break) {
-    curr_char = 0;
-    curr_line++;
-    line_break = false;
+  if (t.type == string_literal && buff.contains("\\n")) {
+    std::string str(buff);
+    for (size_t n = str.find("\\n"); n != std::string::npos;
+         n = str.find("\\n"))
+      str.replace(n, 2, "\n");
+    t.value = Value::string(str);
   }
   return t;
 }
@@ -217,35 +312,21 @@ Token Lexer::look_ahead(const size_t x) {
 }
 
 void Lexer::tokenize(std::string &filename) {
+  source = utils::Source::open(filename);
+  scan();
+}
 
-  std::ifstream file(filename.c_str());
-#if DEBUG_MODE == 1
-  auto start = std::chrono::steady_clock::now();
-#endif
-  file_str = utils::read_entire_file(file);
-  remove_comments();
+void Lexer::scan() {
+  file_str = {source->data(), source->size()};
+  parsed_tokens.reserve(file_str.size() / 8);
   for (;;) {
     Token t = next_token();
     parsed_tokens.push_back(t);
 
     if (t.type == none)
       continue;
-
-#if DEBUG_MODE == 1
-    std::println("{:5} -> {:15} ./{}:{}:{}", t.str, token_names[t.type],
-                 filename, t.line_number, t.char_number + 1);
-#endif
     if (t.type == eof)
       break;
   }
-#if DEBUG_MODE == 1
-  auto end = std::chrono::steady_clock::now();
-  std::println(
-      "[INFO] file lexing took {}",
-      std::chrono::duration_cast<std::chrono::microseconds>(end - start));
-  for (auto &t : parsed_tokens) {
-    std::println("'{}' line: {} char: {}", t.str, t.line_number, t.char_number);
-  }
-#endif
 }
 }; // namespace lexer
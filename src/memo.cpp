@@ -0,0 +1,134 @@
+#include <memo.hpp>
+
+#include <array.hpp>
+#include <bit>
+#include <cstring>
+#include <effects.hpp>
+#include <print>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace memo {
+
+size_t Hash::operator()(const Arguments &args) const {
+  uint64_t h = 0;
+  for (const Value &v : args)
+    h = (h ^ std::bit_cast<uint64_t>(v)) * 0x100000001b3;
+  return h;
+}
+
+bool Equal::operator()(const Arguments &a, const Arguments &b) const {
+  return std::memcmp(a.data(), b.data(), sizeof(Arguments)) == 0;
+}
+
+namespace {
+
+// arrays and strings are handles, which a run frees and the next one
+// hands out again, while the caches live as long as the program
+bool by_handle(const Type type) {
+  return type == STRING || array::is_array(type);
+}
+
+bool memoizable(effects::Analysis &effects, const Function &function) {
+  if (function.arguments.size() > max_arguments ||
+      by_handle(function.return_type))
+    return false;
+  for (const auto &[name, type] : function.arguments) {
+    if (by_handle(type))
+      return false;
+  }
+  if (!effects.pure(&function))
+    return false;
+  std::unordered_set<int> read;
+  std::unordered_set<const Function *> seen = {&function};
+  effects.globals_read(function.body, read, seen);
+  return read.empty();
+}
+
+void walk(effects::Analysis &effects, Caches &caches, const Node *node) {
+  if (node == nullptr)
+    return;
+  if (node->type == NodeType::FUNCTION_DECLARATION) {
+    const Function &function = *node->body.front()->function;
+    if (memoizable(effects, function)) {
+      caches.push_back(std::make_unique<Cache>());
+      caches.back()->name = function.name;
+      function.memo = caches.back().get();
+    }
+  }
+  if (node->type == NodeType::FUNCTION_CALL) {
+    // the callee's body is walked where it is declared
+    for (const auto &n : node->body) {
+      if (n->type != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      walk(effects, caches, n);
+    }
+    return;
+  }
+  walk(effects, caches, node->left);
+  walk(effects, caches, node->right);
+  walk(effects, caches, node->condition);
+  for (const auto &n : node->body)
+    walk(effects, caches, n);
+}
+
+} // namespace
+
+Caches analyze(const Node *root, const size_t capacity) {
+  effects::Analysis effects;
+  Caches caches;
+  walk(effects, caches, root);
+  for (const auto &cache : caches)
+    cache->capacity = capacity;
+  return caches;
+}
+
+std::optional<Value> find(const Function &function, const Arguments &args) {
+  Cache &cache = *function.memo;
+  const std::scoped_lock lock(cache.mutex);
+  const auto it = cache.index.find(args);
+  if (it == cache.index.end()) {
+    cache.misses++;
+    return std::nullopt;
+  }
+  cache.hits++;
+  cache.entries.splice(cache.entries.begin(), cache.entries, it->second);
+  return it->second->second;
+}
+
+void insert(const Function &function, const Arguments &args,
+            const Value &result) {
+  Cache &cache = *function.memo;
+  const std::scoped_lock lock(cache.mutex);
+  // another thread may have computed the same call meanwhile
+  if (const auto it = cache.index.find(args); it != cache.index.end()) {
+    cache.entries.splice(cache.entries.begin(), cache.entries, it->second);
+    return;
+  }
+  if (cache.entries.size() >= cache.capacity) {
+    // the oldest entry is reused for the new result
+    const auto last = std::prev(cache.entries.end());
+    cache.index.erase(last->first);
+    cache.evictions++;
+    *last = {args, result};
+    cache.entries.splice(cache.entries.begin(), cache.entries, last);
+  } else {
+    cache.entries.emplace_front(args, result);
+  }
+  cache.index.emplace(args, cache.entries.begin());
+}
+
+void report(const Caches &caches, const size_t capacity) {
+  std::println(stderr, "[INFO] memo: {} functions memoized, {} results each",
+               caches.size(), capacity);
+  if (caches.empty())
+    return;
+  std::println(stderr, "{:<24} {:>12} {:>12} {:>12}", "function", "hits",
+               "misses", "evictions");
+  for (const auto &cache : caches) {
+    std::println(stderr, "{:<24} {:>12} {:>12} {:>12}", cache->name,
+                 cache->hits, cache->misses, cache->evictions);
+  }
+}
+
+} // namespace memo
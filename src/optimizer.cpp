@@ -0,0 +1,140 @@
+#include <optimizer.hpp>
+
+#include <algorithm>
+#include <eval.hpp>
+
+namespace optimizer {
+
+namespace {
+
+struct Optimizer {
+  Stats stats;
+
+  static bool is_literal(const Node *node) {
+    return node != nullptr && node->type == NodeType::LITERAL;
+  }
+
+  static bool is_zero(const Value &x) {
+    return (x.type == INT && x.i == 0) || (x.type == CHAR && x.c == 0) ||
+           (x.type == BOOL && !x.b);
+  }
+
+  // same evaluation as eval_binop, integer division by zero is left for
+  // the program to hit at runtime
+  void fold(Node *node) {
+    fold_children(node);
+    if (node->binop_type == BinOpType::ASSIGNMENT ||
+        !is_literal(node->left) || !is_literal(node->right))
+      return;
+    const Value &x = node->left->value;
+    const Value &y = node->right->value;
+    if (node->binop_type == BinOpType::DIV && x.type != FLOAT &&
+        y.type != FLOAT && is_zero(y))
+      return;
+    const Value result = eval_binop(x, y, node->binop_type);
+    if (!result.has_value())
+      return;
+    node->type = NodeType::LITERAL;
+    node->value = result;
+    node->left = nullptr;
+    node->right = nullptr;
+    stats.folded++;
+  }
+
+  void fold_children(Node *node) {
+    if (node->left != nullptr)
+      visit(node->left);
+    if (node->right != nullptr)
+      visit(node->right);
+    if (node->condition != nullptr)
+      visit(node->condition);
+    for (const auto &n : node->body) {
+      // the callee body is shared, it is visited from its declaration
+      if (node->type == NodeType::FUNCTION_CALL &&
+          n->type != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      visit(n);
+    }
+  }
+
+  void visit(Node *node) {
+    switch (node->type) {
+    case NodeType::BINOP:
+      fold(node);
+      return;
+    case NodeType::FUNCTION_BODY:
+      fold_children(node);
+      prune(node, true);
+      return;
+    case NodeType::ROOT_NODE:
+      fold_children(node);
+      prune(node, false);
+      return;
+    default:
+      fold_children(node);
+      return;
+    }
+  }
+
+  // true when evaluating the node has no observable effect
+  static bool is_pure(const Node *node) {
+    if (node == nullptr)
+      return true;
+    switch (node->type) {
+    case NodeType::LITERAL:
+      return true;
+    case NodeType::IDENTIFIER:
+    case NodeType::EXPRESSION:
+      return std::ranges::all_of(node->body, is_pure);
+    case NodeType::BINOP:
+      return node->binop_type != BinOpType::ASSIGNMENT &&
+             is_pure(node->left) && is_pure(node->right);
+    case NodeType::LOOP_DECLARATION:
+      return is_pure(node->condition) &&
+             std::ranges::all_of(node->body.front()->body, is_pure);
+    default:
+      return false;
+    }
+  }
+
+  // drops dead statements from a block, the last one is kept when it is
+  // the block's value
+  void prune(Node *block, const bool keeps_value) {
+    NodeList &body = block->body;
+    uint32_t count = body.count;
+    if (block->type == NodeType::FUNCTION_BODY) {
+      // nothing runs after a return at the top of a function body
+      for (uint32_t i = 0; i < count; i++) {
+        if (body.items[i]->type == NodeType::RETURN) {
+          stats.removed += count - i - 1;
+          count = i + 1;
+          break;
+        }
+      }
+    }
+
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      Node *n = body.items[i];
+      const bool last = i + 1 == count;
+      if (n->type == NodeType::LOOP_DECLARATION)
+        prune(n->body.front(), keeps_value && last);
+      if (is_pure(n) && !(keeps_value && last)) {
+        stats.removed++;
+        continue;
+      }
+      body.items[out++] = n;
+    }
+    body.count = out;
+  }
+};
+
+} // namespace
+
+Stats optimize(Node *root) {
+  Optimizer optimizer;
+  optimizer.visit(root);
+  return optimizer.stats;
+}
+
+} // namespace optimizer
@@ -0,0 +1,66 @@
+#include <output.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+void Output::configure(const size_t size, const bool line_buffered) {
+  flush();
+  this->size = std::max<size_t>(size, 1);
+  this->line_buffered = line_buffered;
+  buffer = std::make_unique<char[]>(this->size);
+}
+
+void Output::redirect(std::string *target) {
+  flush();
+  this->target = target;
+}
+
+void Output::write(const std::string_view str) {
+  if (used + str.size() > size) {
+    flush();
+    if (str.size() >= size) {
+      write_out(str.data(), str.size());
+      return;
+    }
+  }
+  std::memcpy(buffer.get() + used, str.data(), str.size());
+  used += str.size();
+}
+
+void Output::write_line(const std::string_view line) {
+  write(line);
+  write("\n");
+  if (line_buffered)
+    flush();
+}
+
+void Output::flush() {
+  if (used == 0)
+    return;
+  write_out(buffer.get(), used);
+  used = 0;
+}
+
+void Output::write_out(const char *data, size_t count) {
+  written += count;
+  flushes++;
+  if (target != nullptr) {
+    target->append(data, count);
+    return;
+  }
+  // anything printed through stdio so far comes first
+  std::fflush(stdout);
+  while (count > 0) {
+    const ssize_t n = ::write(STDOUT_FILENO, data, count);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += n;
+    count -= n;
+  }
+}
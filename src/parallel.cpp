@@ -0,0 +1,314 @@
+#include <parallel.hpp>
+
+#include <array.hpp>
+#include <effects.hpp>
+#include <error.hpp>
+#include <eval.hpp>
+#include <jit.hpp>
+#include <print>
+#include <profile.hpp>
+#include <thread_pool.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace parallel {
+
+namespace {
+
+[[noreturn]] void reject(const std::string &reason) {
+  throw Error(std::format("loop parallel: {}", reason));
+}
+
+bool is_variable(const Node *node, const Node *target) {
+  return node->type == NodeType::IDENTIFIER && node->body.empty() &&
+         node->slot == target->slot && node->depth == target->depth;
+}
+
+bool reads(const Node *node, const Node *target) {
+  if (node == nullptr)
+    return false;
+  if (is_variable(node, target))
+    return true;
+  if (node->type == NodeType::FUNCTION_CALL) {
+    return std::ranges::any_of(node->body, [&](const Node *n) {
+      return n->type == NodeType::FUNCTION_CALL_PARAM && reads(n, target);
+    });
+  }
+  return reads(node->left, target) || reads(node->right, target) ||
+         reads(node->condition, target) ||
+         std::ranges::any_of(node->body,
+                             [&](const Node *n) { return reads(n, target); });
+}
+
+// the accesses of one loop body to the variables of its frame
+struct Loop {
+  const Node *node = nullptr;
+  std::unordered_set<int> declared;
+  std::unordered_set<int> assigned;
+  std::unordered_set<int> read;
+  std::unordered_map<int, BinOpType> reduced;
+  std::unordered_set<int> mixed;
+  std::unordered_map<int, std::string_view> names;
+};
+
+struct Analyzer {
+  effects::Analysis effects;
+  Plans plans;
+
+  void assign(Loop &loop, const Node *node) {
+    const Node *target = node->left;
+    if (target->depth != loop.node->depth)
+      reject(std::format("it assigns the global {}", target->name));
+    loop.names[target->slot] = target->name;
+
+    // x = x op e, and x = e op x when op commutes
+    const Node *value = node->right;
+    if (value->type == NodeType::BINOP &&
+        (value->binop_type == BinOpType::PLUS ||
+         value->binop_type == BinOpType::MINUS ||
+         value->binop_type == BinOpType::MUL)) {
+      const bool on_left = is_variable(value->left, target);
+      const bool on_right = value->binop_type != BinOpType::MINUS &&
+                            is_variable(value->right, target);
+      if (on_left || on_right) {
+        const BinOpType op = value->binop_type == BinOpType::MINUS
+                                 ? BinOpType::PLUS
+                                 : value->binop_type;
+        if (const auto [it, added] = loop.reduced.try_emplace(target->slot, op);
+            !added && it->second != op)
+          loop.mixed.insert(target->slot);
+        visit(loop, on_left ? value->right : value->left);
+        return;
+      }
+    }
+    loop.assigned.insert(target->slot);
+    visit(loop, value);
+  }
+
+  void visit(Loop &loop, const Node *node) {
+    if (node == nullptr)
+      return;
+    switch (node->type) {
+    case NodeType::PRINT:
+      reject("it prints");
+    case NodeType::RETURN:
+      reject("it returns");
+    case NodeType::ELEMENT_ASSIGNMENT:
+      reject(std::format("it stores into the array {}",
+                         node->left->left->name));
+    case NodeType::FUNCTION_CALL: {
+      for (const auto &n : node->body) {
+        if (n->type != NodeType::FUNCTION_CALL_PARAM)
+          break;
+        visit(loop, n);
+      }
+      if (!effects.pure(node->function))
+        reject(std::format("it calls {}, which has side effects",
+                           node->function->name));
+      // in a top level loop the callee sees the chunk's copy of the globals
+      if (loop.node->depth == 0) {
+        std::unordered_set<const Function *> seen = {node->function};
+        effects.globals_read(node->function->body, loop.read, seen);
+      }
+      return;
+    }
+    case NodeType::IDENTIFIER:
+      if (node->slot >= 0 && node->body.empty()) {
+        if (node->depth == loop.node->depth) {
+          loop.read.insert(node->slot);
+          loop.names[node->slot] = node->name;
+        }
+        return;
+      }
+      break;
+    case NodeType::VARIABLE_DECLARATION: {
+      const Node *var = node->body.front();
+      const bool carried = std::ranges::any_of(node->body, [&](const Node *n) {
+        return n != var && reads(n->right, var);
+      });
+      if (node->body.size() < 2 || carried)
+        reject(std::format("{} would carry its value over from the previous "
+                           "iteration, initialize it from other variables",
+                           node->name));
+      loop.declared.insert(var->slot);
+      for (const auto &n : node->body)
+        if (n != var)
+          visit(loop, n);
+      return;
+    }
+    case NodeType::LOOP_DECLARATION:
+      loop.declared.insert(node->slot);
+      loop.declared.insert(node->slot + 1);
+      break;
+    case NodeType::BINOP:
+      if (node->binop_type == BinOpType::ASSIGNMENT) {
+        assign(loop, node);
+        return;
+      }
+      break;
+    default:
+      break;
+    }
+    visit(loop, node->left);
+    visit(loop, node->right);
+    visit(loop, node->condition);
+    for (const auto &n : node->body)
+      visit(loop, n);
+  }
+
+  void check(const Node *node) {
+    Loop loop;
+    loop.node = node;
+    visit(loop, node->body.front());
+
+    Plan plan;
+    plan.depth = node->depth;
+    plan.privates = {node->slot};
+    for (const int slot : loop.declared)
+      plan.privates.push_back(slot);
+    for (const int slot : loop.assigned) {
+      if (!loop.declared.contains(slot))
+        reject(std::format("{} is assigned by every iteration, declare it "
+                           "in the loop or make it a reduction",
+                           loop.names[slot]));
+    }
+    for (const auto &[slot, op] : loop.reduced) {
+      if (loop.declared.contains(slot))
+        continue;
+      if (loop.read.contains(slot) || loop.assigned.contains(slot) ||
+          loop.mixed.contains(slot))
+        reject(std::format("{} is reduced, it cannot be read or assigned "
+                           "otherwise in the loop",
+                           loop.names[slot]));
+      plan.reductions.push_back({slot, op});
+    }
+    plans[node] = std::move(plan);
+  }
+
+  void walk(const Node *node) {
+    if (node == nullptr)
+      return;
+    if (node->type == NodeType::LOOP_DECLARATION && node->parallel)
+      check(node);
+    if (node->type == NodeType::FUNCTION_CALL) {
+      // the callee's body is walked where it is declared
+      for (const auto &n : node->body) {
+        if (n->type != NodeType::FUNCTION_CALL_PARAM)
+          break;
+        walk(n);
+      }
+      return;
+    }
+    walk(node->left);
+    walk(node->right);
+    walk(node->condition);
+    for (const auto &n : node->body)
+      walk(n);
+  }
+};
+
+// strings concatenate in chunk order, so they reduce too
+Value identity(const Value &x, const BinOpType op) {
+  if (x.type == STRING)
+    return Value::string("");
+  if (x.type == FLOAT)
+    return op == BinOpType::MUL ? 1.0f : 0.0f;
+  return op == BinOpType::MUL ? 1 : 0;
+}
+
+} // namespace
+
+Plans analyze(const Node *root) {
+  Analyzer analyzer;
+  analyzer.walk(root);
+  return std::move(analyzer.plans);
+}
+
+std::optional<Value> run(const Node *loop, const int count) {
+  if (context.plans == nullptr || context.pool == nullptr)
+    return std::nullopt;
+  ThreadPool &pool = *context.pool;
+  const auto chunks =
+      static_cast<int>(std::min(pool.size(), static_cast<size_t>(count)));
+  const auto it = context.plans->find(loop);
+  if (chunks < 2 || profile::enabled || jit::enabled ||
+      it == context.plans->end())
+    return std::nullopt;
+  const Plan &plan = it->second;
+
+  Value *globals = State::globals;
+  const Function *function = State::function;
+  const Function *global_scope = State::global_scope;
+  Output *output = State::output;
+  array::Heap *heap = array::heap;
+  Strings *strings = Value::strings;
+  Value *frame = plan.depth == 0 ? globals : State::frame;
+  const auto size = static_cast<size_t>(
+      plan.depth == 0 ? global_scope->num_slots : function->num_slots);
+  std::vector<Value> copies(chunks * size);
+  std::vector<Value> results(chunks);
+
+  pool.run(chunks, [&](const size_t chunk) {
+    Value *copy = copies.data() + chunk * size;
+    std::copy_n(frame, size, copy);
+    for (const auto &[slot, op] : plan.reductions)
+      copy[slot] = identity(copy[slot], op);
+
+    // the thread that started the loop gets its own frame back
+    Value *saved_globals =
+        std::exchange(State::globals, plan.depth == 0 ? copy : globals);
+    Value *saved_frame = std::exchange(State::frame, copy);
+    const Function *saved_function = std::exchange(State::function, function);
+    const Function *saved_scope =
+        std::exchange(State::global_scope, global_scope);
+    Output *saved_output = std::exchange(State::output, output);
+    array::Heap *saved_heap = std::exchange(array::heap, heap);
+    Strings *saved_strings = std::exchange(Value::strings, strings);
+    Value *saved_top = State::stack.top;
+    // also when an error leaves the chunk, the pool rethrows it
+    const auto restore = [&] {
+      State::globals = saved_globals;
+      State::frame = saved_frame;
+      State::function = saved_function;
+      State::global_scope = saved_scope;
+      State::output = saved_output;
+      array::heap = saved_heap;
+      Value::strings = saved_strings;
+      State::stack.pop(saved_top != nullptr ? saved_top : State::stack.slots);
+    };
+
+    const auto begin = static_cast<int>(int64_t{count} * chunk / chunks);
+    const auto end = static_cast<int>(int64_t{count} * (chunk + 1) / chunks);
+    try {
+      for (int i = begin; i < end; i++) {
+        copy[loop->slot] = i;
+        results[chunk] = eval(loop->body.front());
+      }
+    } catch (...) {
+      restore();
+      throw;
+    }
+    restore();
+  });
+
+  const Value *last = copies.data() + (chunks - 1) * size;
+  for (const int slot : plan.privates)
+    frame[slot] = last[slot];
+  for (const auto &[slot, op] : plan.reductions) {
+    for (int chunk = 0; chunk < chunks; chunk++)
+      frame[slot] = eval_binop(frame[slot], copies[chunk * size + slot], op);
+  }
+  return results.back();
+}
+
+void warn_sequential(const Plans &plans, std::string_view engine) {
+  if (plans.empty() || engine == "tree")
+    return;
+  std::println(stderr,
+               "[WARNING] loop parallel runs sequentially on the {} engine, "
+               "{} loop{} will not use threads",
+               engine, plans.size(), plans.size() == 1 ? "" : "s");
+}
+
+} // namespace parallel
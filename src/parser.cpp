@@ -1,4 +1,6 @@
-#include <cstring>
+#include <array.hpp>
+#include <error.hpp>
+#include <eval.hpp>
 #include <logging.hpp>
 #include <parser.hpp>
 namespace parser {
@@ -25,14 +27,32 @@ Type get_type(const lexer::Token &t) {
   return UNKNOWN;
 }
 
+namespace {
+
+// `[]` after int or float makes an array type, the lexer is left past it
+Type array_suffix(lexer::Lexer &l, const Type element) {
+  if (!l.expect(lexer::open_bracket))
+    return element;
+  if (element != INT && element != FLOAT) {
+    throw Error(std::format("arrays hold int or float elements, not {}",
+                            TypeNames[element]));
+  }
+  l.next();
+  if (!l.expect(lexer::close_bracket))
+    logging::expected_error(l, l.get(), "]");
+  l.next();
+  return array::of(element);
+}
+
+} // namespace
+
 Function parse_function_header(lexer::Lexer &l) {
   Function fun;
   l.next();
   if (l.expect(lexer::id)) {
-    fun.name = l.get().str;
+    fun.name = l.text();
     if (State::functions.contains(fun.name)) {
-      std::println("Function {} already exists!", fun.name);
-      exit(255);
+      throw Error(std::format("function {} already exists", fun.name), 255);
     }
     l.next();
     if (l.expect(lexer::assign)) {
@@ -42,15 +62,16 @@ Function parse_function_header(lexer::Lexer &l) {
           if (is_any_type(l.get().type)) {
             const auto type = get_type(l.get());
             l.next();
+            const Type argument_type = array_suffix(l, type);
             if (l.expect(lexer::id)) {
-              fun.arguments[l.get().str] = type;
+              fun.arguments.emplace_back(l.text(), argument_type);
             } else {
-              logging::expected_error(l.get(), "identifier");
+              logging::expected_error(l, l.get(), "identifier");
             }
           }
           if (l.get().type == lexer::close_brace ||
               l.get().type == lexer::arrow) {
-            logging::expected_error(l.get(), ")");
+            logging::expected_error(l, l.get(), ")");
           }
         }
         if (l.expect(lexer::arrow)) {
@@ -58,10 +79,11 @@ Function parse_function_header(lexer::Lexer &l) {
           if (is_any_type(l.get().type)) {
             fun.return_type = get_type(l.get());
             l.next();
+            fun.return_type = array_suffix(l, fun.return_type);
             if (l.expect(lexer::open_brace)) {
 
             } else {
-              logging::expected_error(l.get(), "{");
+              logging::expected_error(l, l.get(), "{");
             }
           } else {
             fun.single_expression = true;
@@ -82,9 +104,11 @@ Function parse_function_header(lexer::Lexer &l) {
               case lexer::minus:
               case lexer::id:
               case lexer::ret:
+              case lexer::open_bracket:
+              case lexer::close_bracket:
                 break;
               default:
-                logging::expected_error(l.get(),
+                logging::expected_error(l, l.get(),
                                         "literal, operator or identifier");
                 break;
               }
@@ -93,206 +117,241 @@ Function parse_function_header(lexer::Lexer &l) {
             l.move(-tokens_moved);
           }
         } else {
-          logging::expected_error(l.get(), "->");
+          logging::expected_error(l, l.get(), "->");
         }
       } else {
-        logging::expected_error(l.get(), "(");
+        logging::expected_error(l, l.get(), "(");
       }
 
     } else {
-      logging::expected_error(l.get(), "=");
+      logging::expected_error(l, l.get(), "=");
     }
 
   } else {
-    logging::expected_error(l.get(), "identifier");
+    logging::expected_error(l, l.get(), "identifier");
   }
 
   return fun;
 }
 
-void parse_expression(lexer::Lexer &l, const std::shared_ptr<Node> &node) {
-  if (l.parsed_tokens.empty())
-    return;
-  while (!l.expect(lexer::semicolon) && !l.done()) {
-    switch (l.get().type) {
-    case lexer::int_literal:
-      node->type = NodeType::LITERAL;
-      errno = 0;
-      node->value = static_cast<int>(strtoll(l.get().str.c_str(), nullptr, 10));
-      if (errno == ERANGE) {
-        std::println("error: {}", strerror(errno));
-      }
-      if (l.parsed_tokens.size() <= 1)
-        return;
-      break;
-    case lexer::float_literal:
-      node->type = NodeType::LITERAL;
-      errno = 0;
-      node->value = std::stof(l.get().str);//static_cast<float>(strtoll(l.get().str.c_str(), nullptr, 10));
+namespace {
+
+// binding power of the binary operators, 0 for anything else
+int precedence(const lexer::TokenType t) {
+  switch (t) {
+  case lexer::plus:
+  case lexer::minus:
+    return 1;
+  case lexer::multiply:
+  case lexer::divide:
+    return 2;
+  default:
+    return 0;
+  }
+}
 
-      if (l.parsed_tokens.size() <= 1)
-        return;
-      break;
-    case lexer::string_literal:
-      node->type = NodeType::LITERAL;
-      errno = 0;
-      node->value = l.get().str;
-      if (l.parsed_tokens.size() <= 1)
-        return;
-      break;
-    case lexer::minus:
-      if (l.get().type == lexer::minus)
-        node->binop_type = BinOpType::MINUS;
-    case lexer::divide:
-      if (l.get().type == lexer::divide)
-        node->binop_type = BinOpType::DIV;
-    case lexer::multiply:
-      if (l.get().type == lexer::multiply)
-        node->binop_type = BinOpType::MUL;
-    case lexer::plus: {
-      if (l.get().type == lexer::plus)
-        node->binop_type = BinOpType::PLUS;
-      node->type = NodeType::BINOP;
-      node->left = std::make_shared<Node>();
-      node->right = std::make_shared<Node>();
-      auto ll = l.slice(0, l.current_token);
-      auto rl = l.slice(l.current_token + 1, l.parsed_tokens.size());
-      parse_expression(ll, node->left);
-      parse_expression(rl, node->right);
-
-      if (node->right->type == NodeType::NONE)
-        logging::expected_error(l.look_ahead(1),
-                                "identifier, literal or expression");
-      if (node->left->type == NodeType::NONE)
-        logging::expected_error(l.look_ahead(-1),
-                                "identifier, literal or expression");
-      return;
-    }
-    case lexer::id: {
-      if (!State::vars.contains(l.get().str)) {
-        if (!State::scope_variables.contains(l.get().str)) {
-          if (State::functions.contains(l.get().str)) {
-            std::string func_name = l.get().str;
-            l.next();
-            if (l.next().type == lexer::open_paren) {
-
-              auto func_call_node = node->append(NodeType::FUNCTION_CALL);
-              func_call_node->name = func_name;
-
-              while (l.get().type != lexer::close_paren) {
-                if (l.get().type == lexer::id ||
-                    l.get().type == lexer::int_literal ||
-                    l.get().type == lexer::string_literal ||
-                    l.get().type == lexer::float_literal) {
-                  auto arg_node =
-                      func_call_node->append(NodeType::FUNCTION_CALL_PARAM);
-                  arg_node->name = l.get().str;
-                  if (l.get().type == lexer::int_literal) {
-                    auto arg_val = arg_node->append(NodeType::LITERAL);
-                    arg_val->value =
-                        static_cast<int>(strtol(l.get().str.c_str(), nullptr, 10));
-                  }
-                  if (l.get().type == lexer::string_literal) {
-                    auto arg_val = arg_node->append(NodeType::LITERAL);
-                    arg_val->value = l.get().str;
-                  }
-
-                  if (l.get().type == lexer::float_literal){
-                    auto arg_val = arg_node->append(NodeType::LITERAL);
-                    arg_val->value = std::stof(l.get().str);
-                  }
-                  if (l.get().type == lexer::id) {
-                    auto arg_val = arg_node->append(NodeType::IDENTIFIER);
-                    arg_val->name = l.get().str;
-                  }
-                  l.next();
-                    }
-                if (l.expect(lexer::close_paren)) {
-                  l.next();
-                  break;
-                }
-                if (!l.expect(lexer::comma)) {
-                  logging::expected_error(l.get(), "',' or ')'");
-                }
-                l.next();
-              }
+BinOpType get_binop(const lexer::TokenType t) {
+  switch (t) {
+  case lexer::plus:
+    return BinOpType::PLUS;
+  case lexer::minus:
+    return BinOpType::MINUS;
+  case lexer::multiply:
+    return BinOpType::MUL;
+  case lexer::divide:
+    return BinOpType::DIV;
+  default:
+    return BinOpType::NONE;
+  }
+}
 
-              func_call_node->body.push_back(State::functions[func_name]);
-              func_call_node->function = State::functions[func_name]->function;
-              node->type = NodeType::IDENTIFIER;
-              node->name = func_name;
-              break;
-            }
-          } else {
-            std::println("[ERROR] undeclared variable {}", l.get().str);
-            exit(1);
-          }
-        }
-      }
-      node->type = NodeType::IDENTIFIER;
-      node->name = l.get().str;
-      if (l.parsed_tokens.size() <= 1)
-        return;
-      break;
-    }
-    case lexer::type_int:
-    case lexer::close_brace:
-      logging::expected_error(l.get(), ";");
-      break;
-    case lexer::print:
+void expect_semicolon(lexer::Lexer &l) {
+  if (!l.expect(lexer::semicolon))
+    logging::expected_error(l, l.get(), ";");
+}
+
+Node *parse_binary(lexer::Lexer &l, const Node *node, int min_precedence);
+
+// parses `name(arg, ...)` starting at the name and stops after the ')'
+void parse_call(lexer::Lexer &l, Node *call, const std::string &func_name) {
+  call->set_name(func_name);
+  l.next();
+  if (!l.expect(lexer::open_paren))
+    logging::expected_error(l, l.get(), "(");
+  l.next();
+  while (!l.expect(lexer::close_paren)) {
+    auto arg_node = call->append(NodeType::FUNCTION_CALL_PARAM);
+    arg_node->set_name(l.text());
+    arg_node->body.push_back(parse_binary(l, arg_node, 1));
+    if (l.expect(lexer::comma)) {
       l.next();
-      if (l.expect(lexer::open_paren)) {
+    } else if (!l.expect(lexer::close_paren)) {
+      logging::expected_error(l, l.get(), "',' or ')'");
+    }
+  }
+  l.next();
+
+  // functions declared further down or in another file are linked later
+  const auto it = State::functions.find(func_name);
+  if (it == State::functions.end()) {
+    State::unresolved_calls.push_back(call);
+    return;
+  }
+  call->body.push_back(it->second);
+  call->function = it->second->function;
+}
+
+Node *parse_primary(lexer::Lexer &l, const Node *node) {
+  switch (l.get().type) {
+  case lexer::int_literal:
+  case lexer::float_literal: {
+    auto lit = node->create(NodeType::LITERAL);
+    lit->value = l.next().value;
+    return lit;
+  }
+  case lexer::string_literal: {
+    auto lit = node->create(NodeType::LITERAL);
+    lit->value = Value::string(l.text());
+    l.next();
+    return lit;
+  }
+  case lexer::open_paren: {
+    l.next();
+    Node *expr = parse_binary(l, node, 1);
+    if (!l.expect(lexer::close_paren))
+      logging::expected_error(l, l.get(), ")");
+    l.next();
+    return expr;
+  }
+  case lexer::open_bracket: {
+    auto list = node->create(NodeType::ARRAY);
+    l.next();
+    while (!l.expect(lexer::close_bracket)) {
+      list->body.push_back(parse_binary(l, list, 1));
+      if (l.expect(lexer::comma)) {
         l.next();
-        while (!l.expect(lexer::close_paren)) {
-          if (l.expect(lexer::comma)) {
-          }
-        }
-      } else {
-        logging::expected_error(l.get(), "(");
+      } else if (!l.expect(lexer::close_bracket)) {
+        logging::expected_error(l, l.get(), "',' or ']'");
       }
-      break;
-    default:
-      break;
     }
     l.next();
+    return list;
+  }
+  case lexer::type_int:
+  case lexer::type_float: {
+    // `float[n]` is n zeros
+    auto zeros = node->create(NodeType::ARRAY);
+    zeros->value_type = array::of(get_type(l.next()));
+    if (!l.expect(lexer::open_bracket))
+      logging::expected_error(l, l.get(), "[");
+    l.next();
+    zeros->condition = parse_binary(l, zeros, 1);
+    if (!l.expect(lexer::close_bracket))
+      logging::expected_error(l, l.get(), "]");
+    l.next();
+    return zeros;
+  }
+  case lexer::id: {
+    const std::string_view name = l.text();
+    if (!State::vars.contains(name) && !State::scope_variables.contains(name) &&
+        (State::functions.contains(name) ||
+         l.look_ahead().type == lexer::open_paren)) {
+      // calls are wrapped in an identifier named after the function
+      auto id = node->create(NodeType::IDENTIFIER);
+      id->set_name(name);
+      parse_call(l, id->append(NodeType::FUNCTION_CALL), std::string(name));
+      return id;
+    }
+    auto id = node->create(NodeType::IDENTIFIER);
+    id->set_name(name);
+    // globals of other files are checked when the program is linked
+    if (!State::vars.contains(name) && !State::scope_variables.contains(name))
+      State::unresolved_globals.push_back(id);
+    l.next();
+    if (!l.expect(lexer::open_bracket))
+      return id;
+    auto index = node->create(NodeType::INDEX);
+    index->left = id;
+    l.next();
+    index->right = parse_binary(l, node, 1);
+    if (!l.expect(lexer::close_bracket))
+      logging::expected_error(l, l.get(), "]");
+    l.next();
+    return index;
+  }
+  default:
+    logging::expected_error(l, l.get(), "identifier, literal or expression");
+    return nullptr;
   }
 }
 
-std::shared_ptr<Node> create_expression(lexer::Lexer &l,
-                                        const std::shared_ptr<Node> &node) {
-  const auto expr = node->append(NodeType::EXPRESSION);
-  if (const auto next_semicolon = l.find_next(lexer::semicolon);
-      next_semicolon == std::nullopt) {
-    logging::expected_error(l.get(), ";");
+// precedence climbing, operators of equal precedence associate to the left
+Node *parse_binary(lexer::Lexer &l, const Node *node,
+                   const int min_precedence) {
+  Node *left = parse_primary(l, node);
+  for (int prec = precedence(l.get().type); prec != 0 && prec >= min_precedence;
+       prec = precedence(l.get().type)) {
+    auto binop = node->create(NodeType::BINOP);
+    binop->binop_type = get_binop(l.next().type);
+    binop->left = left;
+    binop->right = parse_binary(l, node, prec + 1);
+    left = binop;
   }
+  return left;
+}
+
+// `name[i] = value;` starting at the name
+void parse_element_assignment(lexer::Lexer &l, Node *node) {
+  auto expr_body = create_expression(node);
+  auto store = expr_body->append(NodeType::ELEMENT_ASSIGNMENT);
+  store->left = store->create(NodeType::NONE);
+  parse_expression(l, store->left);
+  if (store->left->type != NodeType::INDEX || !l.expect(lexer::assign))
+    logging::expected_error(l, l.get(), "=");
+  l.next();
+  store->right = store->create(NodeType::NONE);
+  parse_expression(l, store->right);
+  expect_semicolon(l);
+}
+
+} // namespace
+
+void parse_expression(lexer::Lexer &l, Node *node) {
+  const Node *expr = parse_binary(l, node, 1);
+  Node *parent = node->parent;
+  *node = *expr;
+  node->parent = parent;
+}
+
+Node *create_expression(Node *node) {
+  const auto expr = node->append(NodeType::EXPRESSION);
   return expr->append(NodeType::EXPRESSION);
 }
 
-void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
+void generate_expression(lexer::Lexer &l, Node *node) {
   while (!l.expect(lexer::eof)) {
     switch (l.get().type) {
     case lexer::fn: {
-      Function fun = parse_function_header(l);
+      auto &fun = *node->arena().make<Function>(parse_function_header(l));
       auto func_decl = node->append(NodeType::FUNCTION_DECLARATION);
 
-      func_decl->function = fun;
-      func_decl->name = fun.name;
+      func_decl->function = &fun;
+      func_decl->set_name(fun.name);
       func_decl->parent = node;
       auto func_body = func_decl->append(NodeType::FUNCTION_BODY);
       for (auto &[key, value] : fun.arguments) {
         State::scope_variables[key] = func_decl->append(NodeType::IDENTIFIER);
       }
-      func_body->name = fun.name + "_body";
+      func_body->set_name(fun.name + "_body");
       func_body->parent = func_decl;
-      func_body->function = fun;
+      func_body->function = &fun;
+      fun.body = func_body;
       State::functions[fun.name] = func_body;
 
       if (fun.single_expression) {
-        auto expr_body = create_expression(l, func_body);
-        auto next_semicolon = l.find_next(lexer::semicolon);
-        auto nl = l.slice(l.current_token, next_semicolon.value() + 1);
-        parse_expression(nl, expr_body);
-        l.advance(next_semicolon.value());
+        auto expr_body = create_expression(func_body);
+        parse_expression(l, expr_body);
+        expect_semicolon(l);
       } else {
         node = func_body;
       }
@@ -300,143 +359,105 @@ void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
     }
     case lexer::int_literal: {
       auto lit = node->append(NodeType::LITERAL);
-      lit->value = static_cast<int>(strtol(l.get().str.c_str(), nullptr, 10));
+      lit->value = l.get().value;
       break;
     }
 
     case lexer::float_literal: {
       auto lit = node->append(NodeType::LITERAL);
-      lit->value =  std::stof(l.get().str);
+      lit->value =  l.get().value;
       break;
     }
     case lexer::string_literal: {
       auto lit = node->append(NodeType::LITERAL);
-      lit->value = l.get().str;
+      lit->value = Value::string(l.text());
       break;
     }
     case lexer::id: {
-      if (State::vars.contains(l.get().str)) {
-        std::string var_name = l.get().str;
+      if ((State::vars.contains(l.text()) ||
+           State::scope_variables.contains(l.text())) &&
+          l.look_ahead().type == lexer::open_bracket) {
+        parse_element_assignment(l, node);
+      } else if (State::vars.contains(l.text())) {
+        std::string var_name(l.text());
         l.next();
         if (l.expect(lexer::assign)) {
-          auto expr_body = create_expression(l, node);
-          auto next_semicolon = l.find_next(lexer::semicolon);
-          auto nl = l.slice(l.current_token - 1, next_semicolon.value() + 1);
+          l.next();
+          auto expr_body = create_expression(node);
           auto expr = expr_body->append(NodeType::BINOP);
           expr->binop_type = BinOpType::ASSIGNMENT;
           expr->left = State::vars[var_name];
-          expr->left->name = var_name;
-          expr->right = std::make_shared<Node>();
-          parse_expression(nl, expr->right);
-          l.advance(next_semicolon.value());
+          expr->left->set_name(var_name);
+          expr->right = expr->create(NodeType::NONE);
+          parse_expression(l, expr->right);
+          expect_semicolon(l);
         } else {
           if (l.expect(lexer::semicolon)) {
-            auto &single_expr = node->body.emplace_back();
-            single_expr = State::vars[var_name];
+            node->body.push_back(State::vars[var_name]);
             break;
           }
-          auto expr_body = create_expression(l, node);
-          auto next_semicolon = l.find_next(lexer::semicolon);
-          auto nl = l.slice(l.current_token - 1, next_semicolon.value() + 1);
-
-          parse_expression(nl, expr_body);
-          l.advance(next_semicolon.value());
-        }
-      } else if (State::functions.contains(l.get().str)) {
-        std::string func_name = l.get().str;
-        l.next();
-        if (l.next().type == lexer::open_paren) {
-
-          auto func_call_node = node->append(NodeType::FUNCTION_CALL);
-          func_call_node->name = func_name;
-          int num_args = 0;
-
-          while (l.get().type != lexer::close_paren) {
-            if (l.get().type == lexer::id ||
-                l.get().type == lexer::int_literal ||
-                l.get().type == lexer::string_literal ||
-                l.get().type == lexer::float_literal) {
-              num_args++;
-              auto arg_node =
-                  func_call_node->append(NodeType::FUNCTION_CALL_PARAM);
-              arg_node->name = l.get().str;
-              if (l.get().type == lexer::int_literal) {
-                auto arg_val = arg_node->append(NodeType::LITERAL);
-                arg_val->value = static_cast<int>(strtol(l.get().str.c_str(), nullptr, 10));
-              }
-              if (l.get().type == lexer::string_literal) {
-                auto arg_val = arg_node->append(NodeType::LITERAL);
-                arg_val->value = l.get().str;
-              }
-
-              if (l.get().type == lexer::float_literal) {
-                auto arg_val = arg_node->append(NodeType::LITERAL);
-                arg_val->value = std::stof(l.get().str);
-              }
-              if (l.get().type == lexer::id) {
-                auto arg_val = arg_node->append(NodeType::IDENTIFIER);
-                arg_val->name = l.get().str;
-              }
-              l.next();
-            }
-            if (l.expect(lexer::close_paren)) {
-              l.next();
-              break;
-            }
-            if (!l.expect(lexer::comma)) {
-              logging::expected_error(l.get(), "',' or ')'");
-            }
-            l.next();
-          }
-
-          if (num_args == 0) l.next();
-
-          func_call_node->body.push_back(State::functions[func_name]);
-          func_call_node->function = State::functions[func_name]->function;
-        }
-        if (!l.expect(lexer::semicolon)) {
-          logging::expected_error(l.get(), ";");
+          auto expr_body = create_expression(node);
+          l.move(-1);
+          parse_expression(l, expr_body);
+          expect_semicolon(l);
         }
+      } else if (State::functions.contains(l.text()) ||
+                 l.look_ahead().type == lexer::open_paren) {
+        const std::string func_name(l.text());
+        parse_call(l, node->append(NodeType::FUNCTION_CALL), func_name);
+        expect_semicolon(l);
         break;
+      } else if (l.look_ahead().type == lexer::open_bracket) {
+        parse_element_assignment(l, node);
+      } else if (l.look_ahead().type == lexer::assign) {
+        // a global of another file, link points left at its declaration
+        auto expr_body = create_expression(node);
+        auto expr = expr_body->append(NodeType::BINOP);
+        expr->binop_type = BinOpType::ASSIGNMENT;
+        expr->left = expr->create(NodeType::IDENTIFIER);
+        expr->left->set_name(l.text());
+        l.next();
+        l.next();
+        expr->right = expr->create(NodeType::NONE);
+        parse_expression(l, expr->right);
+        expect_semicolon(l);
+        State::unresolved_globals.push_back(expr);
       } else {
-        logging::expected_error(l.get(), "identifier");
+        logging::expected_error(l, l.get(), "identifier");
       }
       break;
     }
     case lexer::type_float:
     case lexer::type_int: {
+      Type type = get_type(l.get());
       l.next();
+      type = array_suffix(l, type);
       if (l.expect(lexer::id)) {
-        std::string id_name = l.get().str;
+        std::string id_name(l.text());
 
         l.next();
         auto new_node = node->append(NodeType::VARIABLE_DECLARATION);
-        new_node->name = id_name;
+        new_node->set_name(id_name);
+        new_node->value_type = type;
 
         auto var = new_node->append(NodeType::IDENTIFIER);
 
         if (State::vars.contains(id_name)) {
-          std::println("[ERROR] variable {} is already declared.", id_name);
-          exit(1);
+          throw Error(std::format("variable {} is already declared.", id_name));
         }
         State::vars[id_name] = var;
         if (l.expect(lexer::assign)) {
           l.next();
           if (l.expect(lexer::semicolon))
-            logging::expected_error(l.get(),
+            logging::expected_error(l, l.get(),
                                     "identifier, literal or expression");
-          auto next_semicolon = l.find_next(lexer::semicolon);
-          if (next_semicolon == std::nullopt) {
-            logging::expected_error(l.get(), ";");
-          }
-          auto nl = l.slice(l.current_token, next_semicolon.value() + 1);
           auto expr = new_node->append(NodeType::BINOP);
           expr->binop_type = BinOpType::ASSIGNMENT;
           expr->left = State::vars[id_name];
-          expr->left->name = id_name;
-          expr->right = std::make_shared<Node>();
-          parse_expression(nl, expr->right);
-          l.advance(next_semicolon.value());
+          expr->left->set_name(id_name);
+          expr->right = expr->create(NodeType::NONE);
+          parse_expression(l, expr->right);
+          expect_semicolon(l);
         } else {
         }
       }
@@ -444,45 +465,43 @@ void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
     }
 
     case lexer::type_string: {
+      Type type = get_type(l.get());
       l.next();
+      type = array_suffix(l, type);
       if (l.expect(lexer::id)) {
-        std::string id_name = l.get().str;
+        std::string id_name(l.text());
 
         l.next();
         auto new_node = node->append(NodeType::VARIABLE_DECLARATION);
-        new_node->name = id_name;
+        new_node->set_name(id_name);
+        new_node->value_type = type;
 
         auto var = new_node->append(NodeType::IDENTIFIER);
 
         if (State::vars.contains(id_name)) {
-          std::println("[ERROR] variable {} is already declared.", id_name);
-          exit(1);
+          throw Error(std::format("variable {} is already declared.", id_name));
         }
         State::vars[id_name] = var;
         if (l.expect(lexer::assign)) {
           l.next();
           if (l.expect(lexer::semicolon))
-            logging::expected_error(l.get(),
+            logging::expected_error(l, l.get(),
                                     "identifier, literal or expression");
-          auto next_semicolon = l.find_next(lexer::semicolon);
-          if (next_semicolon == std::nullopt) {
-            logging::expected_error(l.get(), ";");
-          }
-          auto nl = l.slice(l.current_token, next_semicolon.value() + 1);
           auto expr = new_node->append(NodeType::BINOP);
           expr->binop_type = BinOpType::ASSIGNMENT;
           expr->left = State::vars[id_name];
-          expr->left->name = id_name;
-          expr->right = std::make_shared<Node>();
-          parse_expression(nl, expr->right);
-          l.advance(next_semicolon.value());
+          expr->left->set_name(id_name);
+          expr->right = expr->create(NodeType::NONE);
+          parse_expression(l, expr->right);
+          expect_semicolon(l);
         } else {
         }
       }
       break;
     }
     case lexer::close_brace: {
-      if (!node->function.single_expression && node->parent != nullptr) {
+      if ((node->function == nullptr || !node->function->single_expression) &&
+          node->parent != nullptr) {
         node = node->parent;
         node = node->parent;
         State::scope_variables.clear();
@@ -493,13 +512,11 @@ void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
       auto ret_node = node->append(NodeType::RETURN);
       l.next();
       if (l.expect(lexer::semicolon)) {
-        logging::expected_error(l.get(), "value, identifier or expression");
+        logging::expected_error(l, l.get(), "value, identifier or expression");
       }
-      auto expr_body = create_expression(l, ret_node);
-      auto next_semicolon = l.find_next(lexer::semicolon);
-      auto nl = l.slice(l.current_token, next_semicolon.value() + 1);
-      parse_expression(nl, expr_body);
-      l.advance(next_semicolon.value());
+      auto expr_body = create_expression(ret_node);
+      parse_expression(l, expr_body);
+      expect_semicolon(l);
       break;
     }
     case lexer::print: {
@@ -509,14 +526,22 @@ void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
         l.next();
         if (l.expect(lexer::string_literal)) {
           auto lit_node = print_node->append(NodeType::LITERAL);
-          lit_node->value = l.get().str;
+          lit_node->value = Value::string(l.text());
+          for (const auto &segment : split_interpolation(l.text())) {
+            if (segment.variable) {
+              lit_node->append(NodeType::IDENTIFIER)->set_name(segment.text);
+            } else {
+              lit_node->append(NodeType::LITERAL)->value =
+                  Value::string(segment.text);
+            }
+          }
         } else if (l.expect(lexer::close_paren)) {
           break;
         } else if (l.expect(lexer::id)) {
           auto id_node = print_node->append(NodeType::IDENTIFIER);
-          id_node->value = State::vars[l.get().str];
+          id_node->set_name(l.text());
         } else {
-          logging::expected_error(l.get(), "string literal or identifier");
+          logging::expected_error(l, l.get(), "string literal or identifier");
         }
       }
       break;
@@ -524,15 +549,21 @@ void generate_expression(lexer::Lexer &l, std::shared_ptr<Node> node) {
 
     case lexer::loop: {
       l.next();
+      // `parallel` is only a keyword when the count follows it
+      const bool parallel = l.expect(lexer::id) && l.text() == "parallel" &&
+                            (l.look_ahead().type == lexer::id ||
+                             l.look_ahead().type == lexer::int_literal);
+      if (parallel)
+        l.next();
       if (l.expect(lexer::id) || l.expect(lexer::int_literal)) {
         auto loop_decl = node->append(NodeType::LOOP_DECLARATION);
         loop_decl->parent = node;
-        loop_decl->condition = std::make_shared<Node>();
-        loop_decl->condition->type = NodeType::EXPRESSION;
+        loop_decl->parallel = parallel;
+        loop_decl->condition = loop_decl->create(NodeType::EXPRESSION);
         auto cond = loop_decl->condition->append(l.get().type == lexer::id ? NodeType::IDENTIFIER:NodeType::LITERAL);
-        cond->name = l.get().str;
+        cond->set_name(l.text());
         if (l.get().type == lexer::int_literal)
-          cond->value = (int)strtol(l.get().str.c_str(), nullptr, 10);
+          cond->value = l.get().value;
         auto loop_body = loop_decl->append(NodeType::LOOP_BODY);
         loop_body->parent = loop_decl;
         node = loop_body;
@@ -0,0 +1,97 @@
+#include <profile.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <print>
+#include <ranges>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace profile {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+struct FunctionProfile {
+  std::string name;
+  uint64_t calls = 0;
+  // active calls, recursive ones are already part of the outermost's time
+  int depth = 0;
+  clock::duration inclusive{};
+  clock::duration exclusive{};
+};
+
+struct Active {
+  FunctionProfile *profile;
+  clock::time_point start;
+  clock::duration children{};
+};
+
+// per thread, every thread runs a program of its own
+thread_local std::unordered_map<const Function *, FunctionProfile> functions;
+thread_local std::vector<Active> active;
+
+double milliseconds(const clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+void enter(const Function *function) {
+  FunctionProfile &p = functions[function];
+  if (p.calls++ == 0)
+    p.name = function->name.empty() ? "<main>" : function->name;
+  p.depth++;
+  active.push_back({&p, clock::now()});
+}
+
+void exit() {
+  const Active call = active.back();
+  active.pop_back();
+  const clock::duration elapsed = clock::now() - call.start;
+  FunctionProfile &p = *call.profile;
+  if (--p.depth == 0)
+    p.inclusive += elapsed;
+  p.exclusive += elapsed - call.children;
+  if (!active.empty())
+    active.back().children += elapsed;
+}
+
+void reset() {
+  functions.clear();
+  active.clear();
+  node_counts.fill(0);
+}
+
+void report() {
+  // functions may be gone by now, only their names are kept
+  std::vector<FunctionProfile> sorted;
+  for (const auto &p : functions | std::views::values)
+    sorted.push_back(p);
+  std::ranges::sort(sorted, [](const auto &a, const auto &b) {
+    return a.exclusive > b.exclusive;
+  });
+  std::println(stderr, "[INFO] profile");
+  std::println(stderr, "{:<24} {:>12} {:>14} {:>14}", "function", "calls",
+               "inclusive ms", "exclusive ms");
+  for (const auto &p : sorted) {
+    std::println(stderr, "{:<24} {:>12} {:>14.3f} {:>14.3f}", p.name, p.calls,
+                 milliseconds(p.inclusive), milliseconds(p.exclusive));
+  }
+
+  std::vector<size_t> types;
+  for (size_t i = 0; i < node_counts.size(); i++) {
+    if (node_counts[i] != 0)
+      types.push_back(i);
+  }
+  std::ranges::sort(types, [](const size_t a, const size_t b) {
+    return node_counts[a] > node_counts[b];
+  });
+  std::println(stderr, "{:<24} {:>12}", "node type", "evaluations");
+  for (const size_t i : types)
+    std::println(stderr, "{:<24} {:>12}", NodeTypeNames[i], node_counts[i]);
+}
+
+} // namespace profile
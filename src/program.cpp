@@ -0,0 +1,153 @@
+#include <program.hpp>
+
+#include <algorithm>
+#include <error.hpp>
+#include <format>
+#include <lexer.hpp>
+#include <parser.hpp>
+#include <timings.hpp>
+#include <utility>
+
+namespace program {
+
+namespace {
+
+// len, and the reductions sum, min and max, unless the program declares a
+// function of the same name; the call becomes the builtin's node
+bool bind_builtin(Node *call, const File &file) {
+  static constexpr std::pair<std::string_view, BinOpType> builtins[] = {
+      {"len", BinOpType::NONE},
+      {"sum", BinOpType::PLUS},
+      {"min", BinOpType::LESS_THAN},
+      {"max", BinOpType::MORE_THAN}};
+  const auto it = std::ranges::find(builtins, call->name,
+                                    &std::pair<std::string_view, BinOpType>::first);
+  if (it == std::end(builtins))
+    return false;
+  if (call->body.size() != 1) {
+    throw Error(std::format("{} takes one array, got {} arguments in {}",
+                            call->name, call->body.size(), file.filename));
+  }
+  call->type = it->second == BinOpType::NONE ? NodeType::LENGTH
+                                             : NodeType::REDUCTION;
+  call->binop_type = it->second;
+  call->body.items[0] = call->body.front()->body.front();
+  return true;
+}
+
+} // namespace
+
+std::unique_ptr<File> parse(const std::shared_ptr<utils::Source> &source,
+                            Timings *timings, const bool dump_tokens) {
+  auto file = std::make_unique<File>();
+  file->filename = source->name();
+  State::vars.clear();
+  State::functions.clear();
+  State::scope_variables.clear();
+  State::unresolved_calls.clear();
+  State::unresolved_globals.clear();
+
+  // comments are skipped by the scanner, they have no phase of their own
+  if (timings != nullptr)
+    timings->begin("lex");
+  lexer::Lexer l(source);
+  if (timings != nullptr)
+    timings->end();
+  if (dump_tokens)
+    l.print_tokens();
+
+  if (timings != nullptr)
+    timings->begin("parse");
+  parser::generate_expression(l, file->unit.root);
+  if (timings != nullptr)
+    timings->end();
+
+  file->functions = std::move(State::functions);
+  file->unresolved_calls = std::move(State::unresolved_calls);
+  file->unresolved_globals = std::move(State::unresolved_globals);
+  State::functions.clear();
+  State::unresolved_calls.clear();
+  State::unresolved_globals.clear();
+  return file;
+}
+
+std::vector<std::unique_ptr<File>>
+parse_all(const std::vector<std::shared_ptr<utils::Source>> &sources,
+          ThreadPool &pool) {
+  std::vector<std::unique_ptr<File>> files(sources.size());
+  // literals are interned into the caller's strings
+  Strings *strings = Value::strings;
+  pool.run(sources.size(), [&](const size_t i) {
+    Strings *saved_strings = std::exchange(Value::strings, strings);
+    files[i] = parse(sources[i], nullptr, false);
+    Value::strings = saved_strings;
+  });
+  return files;
+}
+
+void link(const std::vector<std::unique_ptr<File>> &files, Node *root) {
+  size_t statements = 0;
+  size_t functions = 0;
+  for (const auto &file : files) {
+    statements += file->unit.root->body.size();
+    functions += file->functions.size();
+  }
+  // the identifier each global declares, and the file declaring it
+  NameMap<std::pair<Node *, const File *>> globals;
+  NameMap<const File *> owners;
+  globals.reserve(statements);
+  owners.reserve(functions);
+  State::functions.clear();
+  State::functions.reserve(functions);
+
+  for (const auto &file : files) {
+    for (const auto &n : file->unit.root->body) {
+      if (n->type == NodeType::VARIABLE_DECLARATION) {
+        if (const auto [it, added] =
+                globals.try_emplace(std::string(n->name), n->body.front(),
+                                    file.get());
+            !added) {
+          throw Error(std::format("variable {} is declared in both {} and {}",
+                                  n->name, it->second.second->filename,
+                                  file->filename));
+        }
+      }
+      root->body.push_back(n);
+    }
+    for (const auto &[name, body] : file->functions) {
+      if (const auto [it, added] = owners.try_emplace(name, file.get());
+          !added) {
+        throw Error(std::format("function {} is declared in both {} and {}",
+                                name, it->second->filename, file->filename));
+      }
+      State::functions[name] = body;
+    }
+  }
+
+  for (const auto &file : files) {
+    for (Node *call : file->unresolved_calls) {
+      const auto it = State::functions.find(call->name);
+      if (it == State::functions.end()) {
+        if (bind_builtin(call, *file))
+          continue;
+        throw Error(std::format("undefined function {} in {}", call->name,
+                                file->filename));
+      }
+      call->body.push_back(it->second);
+      call->function = it->second->function;
+    }
+    // the resolver still rejects a global used before it is declared
+    for (Node *use : file->unresolved_globals) {
+      const std::string_view name =
+          use->type == NodeType::BINOP ? use->left->name : use->name;
+      const auto it = globals.find(name);
+      if (it == globals.end()) {
+        throw Error(std::format("undeclared variable {}", name));
+      }
+      if (use->type == NodeType::BINOP)
+        use->left = it->second.first;
+    }
+  }
+}
+
+} // namespace program
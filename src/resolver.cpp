@@ -0,0 +1,145 @@
+#include <resolver.hpp>
+
+#include <error.hpp>
+#include <format>
+#include <ranges>
+
+namespace resolver {
+
+namespace {
+
+struct Scope {
+  Function *function = nullptr;
+  NameMap<int> slots;
+  int depth = 0;
+};
+
+struct Resolver {
+  Scope globals;
+  Scope *scope = &globals;
+  Scope locals;
+
+  static int declare(Scope &s, const std::string_view name, const Type type) {
+    const int slot = s.function->num_slots++;
+    s.function->slot_names.emplace_back(name);
+    s.function->slot_types.push_back(type);
+    if (!name.empty())
+      s.slots[std::string(name)] = slot;
+    return slot;
+  }
+
+  void bind(Node *node, const Scope &s, const int slot) {
+    node->depth = s.depth;
+    node->slot = slot;
+  }
+
+  bool lookup(Node *node) {
+    if (scope != &globals) {
+      if (const auto it = scope->slots.find(node->name);
+          it != scope->slots.end()) {
+        bind(node, *scope, it->second);
+        return true;
+      }
+    }
+    if (const auto it = globals.slots.find(node->name);
+        it != globals.slots.end()) {
+      bind(node, globals, it->second);
+      return true;
+    }
+    return false;
+  }
+
+  void visit_function(const Node *decl) {
+    const Node *body = decl->body.front();
+    Scope *enclosing = scope;
+    Scope saved = std::move(locals);
+
+    locals = {};
+    locals.function = body->function;
+    locals.depth = 1;
+    body->function->num_slots = 0;
+    body->function->slot_names.clear();
+    body->function->slot_types.clear();
+    for (const auto &[name, type] : body->function->arguments)
+      declare(locals, name, type);
+
+    scope = &locals;
+    for (const auto &n : body->body)
+      visit(n);
+
+    scope = enclosing;
+    locals = std::move(saved);
+  }
+
+  void visit(Node *node) {
+    if (node == nullptr)
+      return;
+    switch (node->type) {
+    case NodeType::FUNCTION_DECLARATION:
+      visit_function(node);
+      return;
+    case NodeType::FUNCTION_CALL:
+      for (const auto &n : node->body) {
+        if (n->type != NodeType::FUNCTION_CALL_PARAM)
+          break;
+        visit(n);
+      }
+      return;
+    case NodeType::VARIABLE_DECLARATION: {
+      Node *var = node->body.front();
+      if (!scope->slots.contains(node->name))
+        bind(var, *scope, declare(*scope, node->name, node->value_type));
+      for (const auto &n : node->body | std::views::drop(1))
+        visit(n);
+      return;
+    }
+    case NodeType::IDENTIFIER:
+      if (!lookup(node) && node->body.empty() && !node->name.empty() &&
+          !State::functions.contains(node->name)) {
+        throw Error(std::format("variable {} is not in scope", node->name));
+      }
+      break;
+    case NodeType::PRINT:
+      for (const auto &arg : node->body) {
+        if (arg->type != NodeType::LITERAL) {
+          visit(arg);
+          continue;
+        }
+        // unknown names in a template print nothing
+        for (const auto &segment : arg->body) {
+          if (segment->type == NodeType::IDENTIFIER)
+            lookup(segment);
+        }
+      }
+      return;
+    case NodeType::ARRAY:
+      visit(node->condition);
+      break;
+    case NodeType::LOOP_DECLARATION:
+      visit(node->condition);
+      bind(node, *scope, declare(*scope, "_index", INT));
+      declare(*scope, "", UNKNOWN);
+      break;
+    default:
+      break;
+    }
+    visit(node->left);
+    visit(node->right);
+    for (const auto &n : node->body)
+      visit(n);
+  }
+};
+
+} // namespace
+
+void resolve(Node *root) {
+  Resolver resolver;
+  root->function->num_slots = 0;
+  root->function->slot_names.clear();
+  root->function->slot_types.clear();
+  resolver.globals.function = root->function;
+  for (const auto &n : root->body)
+    resolver.visit(n);
+}
+
+} // namespace resolver
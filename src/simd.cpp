@@ -0,0 +1,408 @@
+#include <simd.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace simd {
+
+namespace {
+
+// the kernels are written once over a vector type V, which is a plain
+// element for the scalar loops and a GCC vector for the wider levels. A
+// level's entry points carry its target attribute, the always inlined
+// kernels are compiled with it. Ints are added, subtracted and multiplied
+// as unsigned so that they wrap
+//
+// no vector crosses a call, the warning about the avx calling convention
+// does not apply
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+template <typename V> constexpr size_t width = sizeof(V) / 4;
+
+template <typename V, typename T>
+[[gnu::always_inline]] inline V load(const T *p) {
+  V v;
+  std::memcpy(&v, p, sizeof(V));
+  return v;
+}
+
+template <typename V, typename T>
+[[gnu::always_inline]] inline void store(T *p, const V &v) {
+  std::memcpy(p, &v, sizeof(V));
+}
+
+template <typename V, typename T>
+[[gnu::always_inline]] inline V splat(const T x) {
+  if constexpr (std::is_same_v<V, T>) {
+    return x;
+  } else {
+    V v;
+    for (size_t k = 0; k < width<V>; k++)
+      v[k] = x;
+    return v;
+  }
+}
+
+template <BinOpType Op, typename V>
+[[gnu::always_inline]] inline V apply(const V &x, const V &y) {
+  if constexpr (Op == BinOpType::PLUS)
+    return x + y;
+  else if constexpr (Op == BinOpType::MINUS)
+    return x - y;
+  else if constexpr (Op == BinOpType::MUL)
+    return x * y;
+  else if constexpr (std::is_same_v<V, int32_t>)
+    // zero divisors are rejected by the caller, INT_MIN / -1 wraps
+    return y == -1 ? static_cast<int32_t>(0u - static_cast<uint32_t>(x))
+                   : x / y;
+  else
+    return x / y;
+}
+
+template <typename V, BinOpType Op, Broadcast B, typename T>
+[[gnu::always_inline]] inline void map(const T *x, const T *y, T *out,
+                                       const size_t n) {
+  size_t i = 0;
+  if constexpr (width<V> > 1) {
+    V a{}, b{};
+    if constexpr (B == Broadcast::LEFT)
+      a = splat<V>(x[0]);
+    if constexpr (B == Broadcast::RIGHT)
+      b = splat<V>(y[0]);
+    for (; i + width<V> <= n; i += width<V>) {
+      if constexpr (B != Broadcast::LEFT)
+        a = load<V>(x + i);
+      if constexpr (B != Broadcast::RIGHT)
+        b = load<V>(y + i);
+      store(out + i, apply<Op>(a, b));
+    }
+  }
+  for (; i < n; i++) {
+    out[i] = apply<Op>(x[B == Broadcast::LEFT ? 0 : i],
+                       y[B == Broadcast::RIGHT ? 0 : i]);
+  }
+}
+
+template <typename V, BinOpType Op, typename T>
+[[gnu::always_inline]] inline void map(const T *x, const T *y, T *out,
+                                       const size_t n,
+                                       const Broadcast broadcast) {
+  switch (broadcast) {
+  case Broadcast::LEFT:
+    return map<V, Op, Broadcast::LEFT>(x, y, out, n);
+  case Broadcast::RIGHT:
+    return map<V, Op, Broadcast::RIGHT>(x, y, out, n);
+  default:
+    return map<V, Op, Broadcast::NONE>(x, y, out, n);
+  }
+}
+
+template <typename L>
+[[gnu::always_inline]] inline void
+map_ints(const BinOpType op, const int32_t *x, const int32_t *y, int32_t *out,
+         const size_t n, const Broadcast broadcast) {
+  const auto *ux = reinterpret_cast<const uint32_t *>(x);
+  const auto *uy = reinterpret_cast<const uint32_t *>(y);
+  auto *uout = reinterpret_cast<uint32_t *>(out);
+  using V = typename L::Uint;
+  switch (op) {
+  case BinOpType::PLUS:
+    return map<V, BinOpType::PLUS>(ux, uy, uout, n, broadcast);
+  case BinOpType::MINUS:
+    return map<V, BinOpType::MINUS>(ux, uy, uout, n, broadcast);
+  case BinOpType::MUL:
+    return map<V, BinOpType::MUL>(ux, uy, uout, n, broadcast);
+  case BinOpType::DIV:
+    // there is no vector integer division
+    return map<int32_t, BinOpType::DIV>(x, y, out, n, broadcast);
+  default:
+    return;
+  }
+}
+
+template <typename L>
+[[gnu::always_inline]] inline void
+map_floats(const BinOpType op, const float *x, const float *y, float *out,
+           const size_t n, const Broadcast broadcast) {
+  using V = typename L::Float;
+  switch (op) {
+  case BinOpType::PLUS:
+    return map<V, BinOpType::PLUS>(x, y, out, n, broadcast);
+  case BinOpType::MINUS:
+    return map<V, BinOpType::MINUS>(x, y, out, n, broadcast);
+  case BinOpType::MUL:
+    return map<V, BinOpType::MUL>(x, y, out, n, broadcast);
+  case BinOpType::DIV:
+    return map<V, BinOpType::DIV>(x, y, out, n, broadcast);
+  default:
+    return;
+  }
+}
+
+template <typename L>
+[[gnu::always_inline]] inline void convert(const int32_t *x, float *out,
+                                           const size_t n) {
+  using Int = typename L::Int;
+  using Float = typename L::Float;
+  size_t i = 0;
+  if constexpr (width<Int> > 1) {
+    for (; i + width<Int> <= n; i += width<Int>)
+      store(out + i, __builtin_convertvector(load<Int>(x + i), Float));
+  }
+  for (; i < n; i++)
+    out[i] = static_cast<float>(x[i]);
+}
+
+// lane k adds the elements i with i % 8 == k, the lanes are combined the
+// way a vector is halved, the remaining elements are added in order
+template <typename V, typename T>
+[[gnu::always_inline]] inline T add_lanes(const T *x, const size_t n) {
+  constexpr size_t count = 8 / width<V>;
+  V lanes[count];
+  for (auto &lane : lanes)
+    lane = splat<V>(T{});
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (size_t k = 0; k < count; k++)
+      lanes[k] += load<V>(x + i + k * width<V>);
+  }
+  T l[8];
+  std::memcpy(l, lanes, sizeof(l));
+  T total = ((l[0] + l[4]) + (l[2] + l[6])) + ((l[1] + l[5]) + (l[3] + l[7]));
+  for (; i < n; i++)
+    total += x[i];
+  return total;
+}
+
+template <bool Max, typename V>
+[[gnu::always_inline]] inline V pick(const V &x, const V &y) {
+  if constexpr (Max)
+    return x > y ? x : y;
+  else
+    return x < y ? x : y;
+}
+
+template <typename V, bool Max, typename T>
+[[gnu::always_inline]] inline T extreme(const T *x, const size_t n) {
+  T best = x[0];
+  size_t i = 0;
+  if constexpr (width<V> > 1) {
+    if (n >= width<V>) {
+      V m = load<V>(x);
+      for (i = width<V>; i + width<V> <= n; i += width<V>)
+        m = pick<Max>(load<V>(x + i), m);
+      T lanes[width<V>];
+      std::memcpy(lanes, &m, sizeof(lanes));
+      for (const T lane : lanes)
+        best = pick<Max>(lane, best);
+    }
+  }
+  for (; i < n; i++)
+    best = pick<Max>(x[i], best);
+  return best;
+}
+
+struct Scalar {
+  using Int = int32_t;
+  using Uint = uint32_t;
+  using Float = float;
+
+  static void binop(const BinOpType op, const int32_t *x, const int32_t *y,
+                    int32_t *out, const size_t n, const Broadcast b) {
+    map_ints<Scalar>(op, x, y, out, n, b);
+  }
+  static void binop(const BinOpType op, const float *x, const float *y,
+                    float *out, const size_t n, const Broadcast b) {
+    map_floats<Scalar>(op, x, y, out, n, b);
+  }
+  static void to_float(const int32_t *x, float *out, const size_t n) {
+    convert<Scalar>(x, out, n);
+  }
+  static int32_t sum(const int32_t *x, const size_t n) {
+    return static_cast<int32_t>(
+        add_lanes<Uint>(reinterpret_cast<const uint32_t *>(x), n));
+  }
+  static float sum(const float *x, const size_t n) {
+    return add_lanes<Float>(x, n);
+  }
+  static int32_t min(const int32_t *x, const size_t n) {
+    return extreme<Int, false>(x, n);
+  }
+  static float min(const float *x, const size_t n) {
+    return extreme<Float, false>(x, n);
+  }
+  static int32_t max(const int32_t *x, const size_t n) {
+    return extreme<Int, true>(x, n);
+  }
+  static float max(const float *x, const size_t n) {
+    return extreme<Float, true>(x, n);
+  }
+};
+
+#if defined(__x86_64__)
+
+struct Sse4 {
+  using Int = int32_t __attribute__((vector_size(16)));
+  using Uint = uint32_t __attribute__((vector_size(16)));
+  using Float = float __attribute__((vector_size(16)));
+
+  [[gnu::target("sse4.1")]] static void
+  binop(const BinOpType op, const int32_t *x, const int32_t *y, int32_t *out,
+        const size_t n, const Broadcast b) {
+    map_ints<Sse4>(op, x, y, out, n, b);
+  }
+  [[gnu::target("sse4.1")]] static void
+  binop(const BinOpType op, const float *x, const float *y, float *out,
+        const size_t n, const Broadcast b) {
+    map_floats<Sse4>(op, x, y, out, n, b);
+  }
+  [[gnu::target("sse4.1")]] static void to_float(const int32_t *x, float *out,
+                                                 const size_t n) {
+    convert<Sse4>(x, out, n);
+  }
+  [[gnu::target("sse4.1")]] static int32_t sum(const int32_t *x,
+                                               const size_t n) {
+    return static_cast<int32_t>(
+        add_lanes<Uint>(reinterpret_cast<const uint32_t *>(x), n));
+  }
+  [[gnu::target("sse4.1")]] static float sum(const float *x, const size_t n) {
+    return add_lanes<Float>(x, n);
+  }
+  [[gnu::target("sse4.1")]] static int32_t min(const int32_t *x,
+                                               const size_t n) {
+    return extreme<Int, false>(x, n);
+  }
+  [[gnu::target("sse4.1")]] static float min(const float *x, const size_t n) {
+    return extreme<Float, false>(x, n);
+  }
+  [[gnu::target("sse4.1")]] static int32_t max(const int32_t *x,
+                                               const size_t n) {
+    return extreme<Int, true>(x, n);
+  }
+  [[gnu::target("sse4.1")]] static float max(const float *x, const size_t n) {
+    return extreme<Float, true>(x, n);
+  }
+};
+
+struct Avx2 {
+  using Int = int32_t __attribute__((vector_size(32)));
+  using Uint = uint32_t __attribute__((vector_size(32)));
+  using Float = float __attribute__((vector_size(32)));
+
+  [[gnu::target("avx2")]] static void
+  binop(const BinOpType op, const int32_t *x, const int32_t *y, int32_t *out,
+        const size_t n, const Broadcast b) {
+    map_ints<Avx2>(op, x, y, out, n, b);
+  }
+  [[gnu::target("avx2")]] static void
+  binop(const BinOpType op, const float *x, const float *y, float *out,
+        const size_t n, const Broadcast b) {
+    map_floats<Avx2>(op, x, y, out, n, b);
+  }
+  [[gnu::target("avx2")]] static void to_float(const int32_t *x, float *out,
+                                               const size_t n) {
+    convert<Avx2>(x, out, n);
+  }
+  [[gnu::target("avx2")]] static int32_t sum(const int32_t *x,
+                                             const size_t n) {
+    return static_cast<int32_t>(
+        add_lanes<Uint>(reinterpret_cast<const uint32_t *>(x), n));
+  }
+  [[gnu::target("avx2")]] static float sum(const float *x, const size_t n) {
+    return add_lanes<Float>(x, n);
+  }
+  [[gnu::target("avx2")]] static int32_t min(const int32_t *x,
+                                             const size_t n) {
+    return extreme<Int, false>(x, n);
+  }
+  [[gnu::target("avx2")]] static float min(const float *x, const size_t n) {
+    return extreme<Float, false>(x, n);
+  }
+  [[gnu::target("avx2")]] static int32_t max(const int32_t *x,
+                                             const size_t n) {
+    return extreme<Int, true>(x, n);
+  }
+  [[gnu::target("avx2")]] static float max(const float *x, const size_t n) {
+    return extreme<Float, true>(x, n);
+  }
+};
+
+#endif
+
+Level detect() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Level::AVX2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return Level::SSE4;
+#endif
+  return Level::SCALAR;
+}
+
+const Level best = detect();
+Level active = best;
+
+// calls f with the active level's kernels
+template <typename F> auto dispatch(F &&f) {
+#if defined(__x86_64__)
+  switch (active) {
+  case Level::AVX2:
+    return f.template operator()<Avx2>();
+  case Level::SSE4:
+    return f.template operator()<Sse4>();
+  default:
+    break;
+  }
+#endif
+  return f.template operator()<Scalar>();
+}
+
+} // namespace
+
+Level supported() { return best; }
+
+Level level() { return active; }
+
+void set_level(const Level level) { active = std::min(level, best); }
+
+void binop(const BinOpType op, const int32_t *x, const int32_t *y,
+           int32_t *out, const size_t n, const Broadcast broadcast) {
+  dispatch([&]<typename L> { L::binop(op, x, y, out, n, broadcast); });
+}
+
+void binop(const BinOpType op, const float *x, const float *y, float *out,
+           const size_t n, const Broadcast broadcast) {
+  dispatch([&]<typename L> { L::binop(op, x, y, out, n, broadcast); });
+}
+
+void to_float(const int32_t *x, float *out, const size_t n) {
+  dispatch([&]<typename L> { L::to_float(x, out, n); });
+}
+
+int32_t sum(const int32_t *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::sum(x, n); });
+}
+
+float sum(const float *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::sum(x, n); });
+}
+
+int32_t min(const int32_t *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::min(x, n); });
+}
+
+float min(const float *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::min(x, n); });
+}
+
+int32_t max(const int32_t *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::max(x, n); });
+}
+
+float max(const float *x, const size_t n) {
+  return dispatch([&]<typename L> { return L::max(x, n); });
+}
+
+} // namespace simd
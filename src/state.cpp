@@ -1,5 +1,104 @@
 #include <definitions.hpp>
 
-std::unordered_map<std::string, std::shared_ptr<Node>> State::vars;
-std::unordered_map<std::string, std::shared_ptr<Node>> State::functions;
-std::unordered_map<std::string, std::shared_ptr<Node>> State::scope_variables;
\ No newline at end of file
+#include <error.hpp>
+#include <print>
+#include <pthread.h>
+#include <unordered_set>
+
+thread_local NameMap<Node *> State::vars;
+thread_local NameMap<Node *> State::functions;
+thread_local NameMap<Node *> State::scope_variables;
+thread_local std::vector<Node *> State::unresolved_calls;
+thread_local std::vector<Node *> State::unresolved_globals;
+Output State::standard_output;
+
+void CallStack::allocate() {
+  // released when the thread exits
+  static thread_local std::unique_ptr<Value[]> storage;
+  storage = std::make_unique<Value[]>(capacity);
+  slots = top = storage.get();
+  limit = slots + capacity;
+
+  // bounds of threads not started by pthreads are unknown, they go unguarded
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0)
+    return;
+  void *low = nullptr;
+  size_t size = 0;
+  if (pthread_attr_getstack(&attr, &low, &size) == 0 && size > native_reserve)
+    native_limit = reinterpret_cast<uintptr_t>(low) + native_reserve;
+  pthread_attr_destroy(&attr);
+}
+
+void CallStack::overflow() {
+  throw Error("stack overflow");
+}
+
+size_t count_nodes(const Node *root) {
+  std::unordered_set<const Node *> seen;
+  std::vector<const Node *> pending = {root};
+  while (!pending.empty()) {
+    const Node *node = pending.back();
+    pending.pop_back();
+    if (node == nullptr || !seen.insert(node).second)
+      continue;
+    pending.insert(pending.end(), node->body.begin(), node->body.end());
+    pending.push_back(node->left);
+    pending.push_back(node->right);
+    pending.push_back(node->condition);
+  }
+  return seen.size();
+}
+
+static std::string format_value(const Value &x) {
+  switch (x.type) {
+  case INT:
+    return std::format("{}", x.i);
+  case FLOAT:
+    return std::format("{}", x.f);
+  case CHAR:
+    return std::format("'{}'", x.c);
+  case BOOL:
+    return std::format("{}", x.b);
+  case STRING:
+    return std::format("\"{}\"", x.str());
+  default:
+    return "";
+  }
+}
+
+static void dump_node(const Node *node, const int indent) {
+  std::print("{:{}}{}", "", indent * 2,
+             NodeTypeNames[static_cast<int>(node->type)]);
+  if (node->type == NodeType::BINOP)
+    std::print(" {}", BinOpTypeNames[static_cast<int>(node->binop_type)]);
+  if (node->parallel)
+    std::print(" parallel");
+  if (node->specialization != Specialization::NONE)
+    std::print(" {}",
+               SpecializationNames[static_cast<int>(node->specialization)]);
+  if (!node->name.empty())
+    std::print(" '{}'", node->name);
+  if (node->type == NodeType::LITERAL)
+    std::print(" {}", format_value(node->value));
+  if (node->slot >= 0)
+    std::print(" slot {}:{}", node->depth, node->slot);
+  std::println("");
+
+  if (node->condition != nullptr)
+    dump_node(node->condition, indent + 1);
+  if (node->left != nullptr)
+    dump_node(node->left, indent + 1);
+  if (node->right != nullptr)
+    dump_node(node->right, indent + 1);
+  for (const auto &n : node->body) {
+    // calls end with the callee's shared body, only name it
+    if (node->type == NodeType::FUNCTION_CALL && n == node->body.back()) {
+      std::println("{:{}}-> {}", "", (indent + 1) * 2, n->name);
+      break;
+    }
+    dump_node(n, indent + 1);
+  }
+}
+
+void dump_ast(const Node *root) { dump_node(root, 0); }
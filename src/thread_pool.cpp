@@ -0,0 +1,87 @@
+#include <thread_pool.hpp>
+
+#include <utility>
+
+namespace {
+
+// set while a thread works on a batch, nested batches run inline
+thread_local bool in_batch = false;
+
+} // namespace
+
+ThreadPool::ThreadPool(const size_t threads) {
+  for (size_t i = 1; i < threads; i++)
+    workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::scoped_lock lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+ThreadPool &ThreadPool::shared() {
+  // never destroyed, exiting never has to wait for its workers
+  static ThreadPool *pool = new ThreadPool(shared_size);
+  return *pool;
+}
+
+void ThreadPool::drain() {
+  for (size_t i = next++; i < count; i = next++) {
+    try {
+      (*task)(i);
+    } catch (...) {
+      // run rethrows the first error, the tasks not started are skipped
+      const std::scoped_lock lock(mutex);
+      if (error == nullptr)
+        error = std::current_exception();
+      next = count;
+    }
+  }
+}
+
+void ThreadPool::work() {
+  in_batch = true;
+  uint64_t seen = 0;
+  std::unique_lock lock(mutex);
+  for (;;) {
+    wake.wait(lock, [&] { return stopping || batch != seen; });
+    if (stopping)
+      return;
+    seen = batch;
+    lock.unlock();
+    drain();
+    lock.lock();
+    if (--busy == 0)
+      done.notify_one();
+  }
+}
+
+void ThreadPool::run(const size_t count,
+                     const std::function<void(size_t)> &task) {
+  if (workers.empty() || in_batch || count <= 1) {
+    for (size_t i = 0; i < count; i++)
+      task(i);
+    return;
+  }
+  {
+    const std::scoped_lock lock(mutex);
+    this->task = &task;
+    this->count = count;
+    next = 0;
+    busy = workers.size();
+    batch++;
+  }
+  wake.notify_all();
+  in_batch = true;
+  drain();
+  in_batch = false;
+  std::unique_lock lock(mutex);
+  done.wait(lock, [&] { return busy == 0; });
+  if (error != nullptr)
+    std::rethrow_exception(std::exchange(error, nullptr));
+}
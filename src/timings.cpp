@@ -0,0 +1,57 @@
+#include <timings.hpp>
+
+#include <print>
+#include <sys/resource.h>
+
+static long peak_rss_kb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void Timings::begin(const std::string_view phase) {
+  end();
+  phases.push_back({std::string(phase)});
+  running = true;
+  start = clock::now();
+}
+
+void Timings::end() {
+  if (!running)
+    return;
+  const auto elapsed = clock::now() - start;
+  phases.back().milliseconds =
+      std::chrono::duration<double, std::milli>(elapsed).count();
+  phases.back().peak_rss_kb = peak_rss_kb();
+  running = false;
+}
+
+void Timings::report(const bool json) const {
+  double total = 0;
+  for (const auto &phase : phases)
+    total += phase.milliseconds;
+
+  if (json) {
+    std::string out = "{\"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++) {
+      out += std::format("{}{{\"name\": \"{}\", \"wall_ms\": {:.3f}, "
+                         "\"peak_rss_kb\": {}}}",
+                         i == 0 ? "" : ", ", phases[i].name,
+                         phases[i].milliseconds, phases[i].peak_rss_kb);
+    }
+    out += std::format("], \"total_ms\": {:.3f}, \"peak_rss_kb\": {}}}", total,
+                       peak_rss_kb());
+    std::println(stderr, "{}", out);
+    return;
+  }
+
+  std::println(stderr, "[INFO] timings");
+  std::println(stderr, "{:<12} {:>12} {:>14}", "phase", "wall ms",
+               "peak rss KB");
+  for (const auto &phase : phases) {
+    std::println(stderr, "{:<12} {:>12.3f} {:>14}", phase.name,
+                 phase.milliseconds, phase.peak_rss_kb);
+  }
+  std::println(stderr, "{:<12} {:>12.3f} {:>14}", "total", total,
+               peak_rss_kb());
+}
@@ -0,0 +1,314 @@
+#include <typecheck.hpp>
+
+#include <array.hpp>
+#include <error.hpp>
+#include <eval.hpp>
+#include <format>
+#include <unordered_map>
+#include <utility>
+
+namespace typecheck {
+
+namespace {
+
+// a value of the given type, used to ask the runtime what an operator
+// produces so the checker and eval_binop cannot disagree
+Value sample(const Type type) {
+  switch (type) {
+  case INT:
+    return 1;
+  case FLOAT:
+    return 1.0f;
+  case BOOL:
+    return true;
+  case CHAR:
+    return static_cast<char>(1);
+  case STRING:
+    return Value::string("");
+  default:
+    return {};
+  }
+}
+
+struct Checker {
+  Stats stats;
+  const Function *globals = nullptr;
+  const Function *current = nullptr;
+  // result types of the functions checked so far, UNKNOWN while a
+  // function's own body is being checked
+  std::unordered_map<const Function *, Type> results;
+
+  [[nodiscard]] Type slot_type(const Node *node) const {
+    const Function *function = node->depth == 0 ? globals : current;
+    return function->slot_types[node->slot];
+  }
+
+  // false when a value of type `got` cannot be stored as `expected`
+  bool store(Node *node, Node *value, const Type expected, const Type got) {
+    node->value_type = expected;
+    if (got == expected || expected == UNKNOWN)
+      return true;
+    if (got == UNKNOWN) {
+      node->specialization = Specialization::CHECKED;
+      stats.dynamic++;
+      return true;
+    }
+    // an int array literal is built as a float[] instead
+    if (got == INT_ARRAY && expected == FLOAT_ARRAY &&
+        value->type == NodeType::ARRAY && value->condition == nullptr) {
+      value->value_type = FLOAT_ARRAY;
+      return true;
+    }
+    if (got != INT || expected != FLOAT)
+      return false;
+    if (value->type == NodeType::LITERAL) {
+      value->value = static_cast<float>(value->value.i);
+      return true;
+    }
+    node->specialization = Specialization::TO_FLOAT;
+    stats.specialized++;
+    return true;
+  }
+
+  Type binop(Node *node) {
+    const Type x = check(node->left);
+    const Type y = check(node->right);
+    if (x == UNKNOWN || y == UNKNOWN) {
+      stats.dynamic++;
+      return UNKNOWN;
+    }
+    const Type result =
+        array::is_array(x) || array::is_array(y)
+            ? array::result_type(x, y, node->binop_type)
+            : eval_binop(sample(x), sample(y), node->binop_type).type;
+    if (result == VOID) {
+      throw Error(std::format(
+          "type error: {} is not defined for {} and {}",
+          BinOpTypeNames[static_cast<int>(node->binop_type)], TypeNames[x],
+          TypeNames[y]));
+    }
+    node->value_type = result;
+
+    if (x == INT && y == INT)
+      node->specialization = Specialization::INT_INT;
+    else if (x == FLOAT && y == FLOAT)
+      node->specialization = Specialization::FLOAT_FLOAT;
+    else if (x == INT && y == FLOAT)
+      node->specialization = Specialization::INT_FLOAT;
+    else if (x == FLOAT && y == INT)
+      node->specialization = Specialization::FLOAT_INT;
+    if (node->specialization != Specialization::NONE)
+      stats.specialized++;
+    else
+      stats.dynamic++;
+    return result;
+  }
+
+  Type call(Node *node) {
+    const Function &function = *node->function;
+    size_t index = 0;
+    for (const auto &n : node->body) {
+      if (n->type != NodeType::FUNCTION_CALL_PARAM)
+        break;
+      const Type got = check(n->body.front());
+      if (index < function.arguments.size()) {
+        const auto &[name, expected] = function.arguments[index];
+        if (!store(n, n->body.front(), expected, got)) {
+          throw Error(std::format(
+              "type error: argument {} of {} expects {}, got {}", name,
+              function.name, TypeNames[expected], TypeNames[got]));
+        }
+      }
+      index++;
+    }
+    const auto it = results.find(&function);
+    return it != results.end() ? it->second : UNKNOWN;
+  }
+
+  // the value of a block is its last statement's, a function body stops at
+  // its first top level return
+  Type block(const Node *node) {
+    Type result = VOID;
+    bool returned = false;
+    for (const auto &n : node->body) {
+      const Type type = check(n);
+      if (returned)
+        continue;
+      result = type;
+      returned = node->type == NodeType::FUNCTION_BODY &&
+                 n->type == NodeType::RETURN;
+    }
+    return result;
+  }
+
+  void check_function(const Node *body) {
+    Function *function = body->function;
+    results[function] = UNKNOWN;
+    const Function *caller = std::exchange(current, function);
+    Type result = block(body);
+    current = caller;
+
+    if (function->return_type == VOID) {
+      result = VOID;
+    } else if (function->single_expression) {
+      if (result != UNKNOWN)
+        function->return_type = result;
+    } else if (result != UNKNOWN && result != function->return_type) {
+      throw Error(std::format("type error: function {} returns {}, declared {}",
+                              function->name, TypeNames[result],
+                              TypeNames[function->return_type]));
+    }
+    results[function] = result;
+  }
+
+  void expect_int(Node *node, const std::string_view what) {
+    const Type type = check(node);
+    if (type != INT && type != UNKNOWN) {
+      throw Error(std::format("type error: {} must be an int, got {}", what,
+                              TypeNames[type]));
+    }
+  }
+
+  // a literal is float[] when any element is a float, int[] when all are
+  // ints and left to the runtime otherwise
+  Type array_literal(Node *node) {
+    if (node->condition != nullptr) {
+      expect_int(node->condition, "an array length");
+      return node->value_type;
+    }
+    bool known = true;
+    bool floats = false;
+    for (const auto &n : node->body) {
+      const Type type = check(n);
+      if (type == UNKNOWN) {
+        known = false;
+      } else if (type == FLOAT) {
+        floats = true;
+      } else if (type != INT) {
+        throw Error(std::format(
+            "type error: array elements must be INT or FLOAT, got {}",
+            TypeNames[type]));
+      }
+    }
+    if (floats)
+      node->value_type = FLOAT_ARRAY;
+    else if (known)
+      node->value_type = INT_ARRAY;
+    return node->value_type;
+  }
+
+  // the argument of len, sum, min or max
+  Type array_argument(const Node *node) {
+    const Type type = check(node->body.front());
+    if (type != UNKNOWN && !array::is_array(type)) {
+      throw Error(std::format("type error: {} expects an array, got {}",
+                              node->name, TypeNames[type]));
+    }
+    return type;
+  }
+
+  Type index(const Node *node) {
+    const Type type = check(node->left);
+    expect_int(node->right, "an index");
+    if (type == UNKNOWN)
+      return UNKNOWN;
+    if (!array::is_array(type)) {
+      throw Error(std::format("type error: cannot index {}", TypeNames[type]));
+    }
+    return array::element_type(type);
+  }
+
+  Type loop(const Node *node) {
+    const Type count = check(node->condition);
+    if (count == STRING || count == VOID || array::is_array(count)) {
+      throw Error(std::format("type error: loop count must be numeric, got {}",
+                              TypeNames[count]));
+    }
+    const Type result = check(node->body.front());
+    // a loop that never runs has no value
+    const Node *bound = node->condition->body.front();
+    if (bound->type != NodeType::LITERAL)
+      return UNKNOWN;
+    return bound->value.to_int() > 0 ? result : VOID;
+  }
+
+  Type check(Node *node) {
+    switch (node->type) {
+    case NodeType::LITERAL:
+      return node->value.type;
+    case NodeType::IDENTIFIER:
+      if (node->slot >= 0)
+        return slot_type(node);
+    case NodeType::EXPRESSION:
+      return node->body.empty() ? INT : check(node->body.front());
+    case NodeType::BINOP:
+      if (node->binop_type == BinOpType::ASSIGNMENT) {
+        const Type expected = slot_type(node->left);
+        const Type got = check(node->right);
+        if (!store(node, node->right, expected, got)) {
+          throw Error(std::format(
+              "type error: cannot assign {} to {} variable {}", TypeNames[got],
+              TypeNames[expected], node->left->name));
+        }
+        return expected == UNKNOWN ? got : expected;
+      }
+      return binop(node);
+    case NodeType::FUNCTION_CALL:
+      return call(node);
+    case NodeType::FUNCTION_DECLARATION:
+      check_function(node->body.front());
+      return INT;
+    case NodeType::VARIABLE_DECLARATION:
+      for (const auto &n : node->body) {
+        if (n->type == NodeType::BINOP)
+          check(n);
+      }
+      return INT;
+    case NodeType::RETURN: {
+      Type result = node->value.type;
+      for (const auto &n : node->body)
+        result = check(n);
+      return result;
+    }
+    case NodeType::LOOP_DECLARATION:
+      return loop(node);
+    case NodeType::LOOP_BODY:
+      return block(node);
+    case NodeType::ARRAY:
+      return array_literal(node);
+    case NodeType::INDEX:
+      return index(node);
+    case NodeType::ELEMENT_ASSIGNMENT: {
+      const Type expected = index(node->left);
+      const Type got = check(node->right);
+      if (!store(node, node->right, expected, got)) {
+        throw Error(std::format(
+            "type error: cannot store {} in an element of {}", TypeNames[got],
+            node->left->left->name));
+      }
+      return expected == UNKNOWN ? got : expected;
+    }
+    case NodeType::LENGTH:
+      array_argument(node);
+      return INT;
+    case NodeType::REDUCTION: {
+      const Type type = array_argument(node);
+      return type == UNKNOWN ? UNKNOWN : array::element_type(type);
+    }
+    default:
+      return INT;
+    }
+  }
+};
+
+} // namespace
+
+Stats check(Node *root) {
+  Checker checker;
+  checker.globals = checker.current = root->function;
+  for (const auto &n : root->body)
+    checker.check(n);
+  return checker.stats;
+}
+
+} // namespace typecheck
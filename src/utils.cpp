@@ -0,0 +1,63 @@
+#include <utils.hpp>
+
+#include <error.hpp>
+#include <fcntl.h>
+#include <format>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils {
+
+std::shared_ptr<Source> Source::open(const std::string &filename) {
+  auto source = try_open(filename);
+  if (source == nullptr) {
+    throw Error(std::format("could not open file {}", filename));
+  }
+  return source;
+}
+
+std::shared_ptr<Source> Source::try_open(const std::string &filename) {
+  std::shared_ptr<Source> source(new Source());
+  source->filename = filename;
+
+  if (const int fd = ::open(filename.c_str(), O_RDONLY); fd >= 0) {
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        source->buffer = static_cast<const char *>(addr);
+        source->length = st.st_size;
+        source->is_mapped = true;
+      }
+    }
+    close(fd);
+    if (source->is_mapped)
+      return source;
+  }
+
+  std::ifstream file(filename, std::ios::binary);
+  if (!file)
+    return nullptr;
+  source->contents = read_entire_file(file);
+  source->buffer = source->contents.data();
+  source->length = source->contents.size();
+  return source;
+}
+
+std::shared_ptr<Source> Source::from_string(std::string contents,
+                                            std::string name) {
+  std::shared_ptr<Source> source(new Source());
+  source->filename = std::move(name);
+  source->contents = std::move(contents);
+  source->buffer = source->contents.data();
+  source->length = source->contents.size();
+  return source;
+}
+
+Source::~Source() {
+  if (is_mapped)
+    munmap(const_cast<char *>(buffer), length);
+}
+
+} // namespace utils
@@ -0,0 +1,52 @@
+#include <value.hpp>
+
+#include <algorithm>
+
+Strings Value::process_strings;
+
+uint32_t Strings::intern(const std::string_view str) {
+  const std::scoped_lock lock(mutex);
+  if (const auto it = handles.find(str); it != handles.end())
+    return it->second;
+  const uint32_t handle = count++;
+  const size_t k = std::bit_width(handle / first_chunk + 1) - 1;
+  if (chunks[k] == nullptr)
+    chunks[k] = std::make_unique<std::string[]>(first_chunk << k);
+  std::string &stored = slot(handle);
+  stored = str;
+  handles[stored] = handle;
+  return handle;
+}
+
+uint32_t Strings::size() {
+  const std::scoped_lock lock(mutex);
+  return count;
+}
+
+void Strings::release(const uint32_t mark) {
+  const std::scoped_lock lock(mutex);
+  for (uint32_t handle = mark; handle < count; handle++) {
+    handles.erase(slot(handle));
+    templates.erase(handle);
+    // the chunk is kept, the characters are freed
+    slot(handle) = {};
+  }
+  count = std::min(count, mark);
+}
+
+const std::vector<Segment> &
+Strings::segments(const uint32_t handle,
+                  std::vector<Segment> (*split)(std::string_view)) {
+  const std::scoped_lock lock(mutex);
+  auto [it, inserted] = templates.try_emplace(handle);
+  if (inserted)
+    it->second = split(slot(handle));
+  return it->second;
+}
+
+Value Value::string(const std::string_view str) {
+  Value v;
+  v.type = STRING;
+  v.handle = strings->intern(str);
+  return v;
+}
@@ -0,0 +1,249 @@
+#include <vm.hpp>
+
+#include <error.hpp>
+#include <eval.hpp>
+#include <format>
+#include <jit.hpp>
+#include <memo.hpp>
+
+namespace vm {
+
+using bytecode::OpCode;
+
+struct Frame {
+  size_t return_ip = 0;
+  size_t base = 0;
+  int function = 0;
+};
+
+static Value *lookup(const bytecode::Program &program,
+                     std::vector<Value> &stack, const Frame &frame,
+                     const std::string &name) {
+  const auto &locals = program.functions[frame.function].locals;
+  for (size_t i = locals.size(); i-- > 0;) {
+    if (locals[i] == name)
+      return &stack[frame.base + i];
+  }
+  const auto &globals = program.functions[0].locals;
+  for (size_t i = globals.size(); i-- > 0;) {
+    if (globals[i] == name)
+      return &stack[i];
+  }
+  return nullptr;
+}
+
+void run(const bytecode::Program &program) {
+  std::vector<Value> stack;
+  std::vector<Frame> frames;
+  // arguments of the memoized calls in progress, innermost last
+  std::vector<memo::Arguments> memo_keys;
+  std::string line;
+
+  stack.reserve(CallStack::capacity);
+  frames.reserve(CallStack::capacity / 16);
+  stack.resize(program.functions[0].num_locals, 0);
+  frames.push_back({});
+
+  const auto *code = program.code.data();
+  size_t ip = 0;
+  for (;;) {
+    const auto &in = code[ip++];
+    switch (in.op) {
+    case OpCode::PUSH_CONST:
+      stack.push_back(program.constants[in.a]);
+      break;
+    case OpCode::PUSH_EMPTY:
+      stack.emplace_back();
+      break;
+    case OpCode::POP:
+      stack.pop_back();
+      break;
+    case OpCode::LOAD_GLOBAL:
+      stack.push_back(stack[in.a]);
+      break;
+    case OpCode::STORE_GLOBAL:
+      if (in.b != 0)
+        array::release(stack[in.a]);
+      stack[in.a] = stack.back();
+      break;
+    case OpCode::LOAD_LOCAL:
+      stack.push_back(stack[frames.back().base + in.a]);
+      break;
+    case OpCode::STORE_LOCAL: {
+      Value &target = stack[frames.back().base + in.a];
+      if (in.b != 0)
+        array::release(target);
+      target = stack.back();
+      break;
+    }
+    case OpCode::BINOP: {
+      const Value y = stack.back();
+      stack.pop_back();
+      const Value x = stack.back();
+      stack.back() = eval_binop(x, y, static_cast<BinOpType>(in.a));
+      array::release(static_cast<uint8_t>(in.b), x, y);
+      break;
+    }
+    case OpCode::BINOP_INT: {
+      const Value y = stack.back();
+      stack.pop_back();
+      stack.back() = binop_table[binop_index(
+          INT, INT, static_cast<BinOpType>(in.a))](stack.back(), y);
+      break;
+    }
+    case OpCode::BINOP_FLOAT: {
+      const Value y = stack.back();
+      stack.pop_back();
+      stack.back() = binop_table[binop_index(
+          FLOAT, FLOAT, static_cast<BinOpType>(in.a))](stack.back(), y);
+      break;
+    }
+    case OpCode::TO_FLOAT:
+      stack.back() = static_cast<float>(stack.back().i);
+      break;
+    case OpCode::CHECK_TYPE:
+      stack.back() = convert(stack.back(), Specialization::CHECKED,
+                             static_cast<Type>(in.a));
+      break;
+    case OpCode::CALL: {
+      const auto &f = program.functions[in.a];
+      if (in.b != f.arity) {
+        throw Error(std::format(
+            "when calling function {}: parameter count missmatch", f.name));
+      }
+      if (frames.size() == frames.capacity() ||
+          stack.size() + f.num_locals + 1024 > stack.capacity())
+        CallStack::overflow();
+      const size_t base = stack.size() - in.b;
+      const bool memoized =
+          f.function != nullptr && f.function->memo != nullptr;
+      if (memoized) {
+        memo_keys.push_back(memo::arguments(*f.function, &stack[base]));
+        if (const auto cached = memo::find(*f.function, memo_keys.back())) {
+          memo_keys.pop_back();
+          stack.resize(base);
+          stack.push_back(*cached);
+          break;
+        }
+      }
+      stack.resize(stack.size() + f.num_locals - f.arity, 0);
+      if (const jit::Code code = jit::enabled && f.function != nullptr
+                                     ? jit::enter(*f.function)
+                                     : nullptr) {
+        Value result;
+        code(&stack[base], &result);
+        stack.resize(base);
+        stack.push_back(result);
+        if (memoized) {
+          memo::insert(*f.function, memo_keys.back(), result);
+          memo_keys.pop_back();
+        }
+        break;
+      }
+      frames.push_back({ip, base, in.a});
+      ip = f.entry;
+      break;
+    }
+    case OpCode::RETURN: {
+      const Value value = stack.back();
+      const auto frame = frames.back();
+      frames.pop_back();
+      if (const Function *function = program.functions[frame.function].function;
+          function != nullptr) {
+        array::release_locals(*function, &stack[frame.base]);
+        if (function->memo != nullptr) {
+          memo::insert(*function, memo_keys.back(), value);
+          memo_keys.pop_back();
+        }
+      }
+      stack.resize(frame.base);
+      stack.push_back(value);
+      ip = frame.return_ip;
+      break;
+    }
+    case OpCode::JUMP:
+      ip = in.a;
+      break;
+    case OpCode::LOOP: {
+      const size_t base = frames.back().base;
+      if (stack[base + in.a].to_int() >= stack[base + in.a + 1].to_int())
+        ip = in.b;
+      break;
+    }
+    case OpCode::INCREMENT: {
+      auto &index = stack[frames.back().base + in.a];
+      index = index.to_int() + 1;
+      break;
+    }
+    case OpCode::EMIT_CONST:
+      line += program.constants[in.a].str();
+      break;
+    case OpCode::EMIT_VALUE:
+      format_value(line, stack.back());
+      stack.pop_back();
+      break;
+    case OpCode::EMIT_STRING: {
+      const Value value = stack.back();
+      stack.pop_back();
+      if (value.type != STRING)
+        break;
+      for (const auto &segment : interpolation_segments(value)) {
+        if (!segment.variable)
+          line += segment.text;
+        else if (const auto *x =
+                     lookup(program, stack, frames.back(), segment.text))
+          format_value(line, *x);
+      }
+      break;
+    }
+    case OpCode::PRINT_LINE:
+      write_line(line);
+      break;
+    case OpCode::MAKE_ARRAY: {
+      // the elements are the top b values
+      const size_t begin = stack.size() - in.b;
+      const Value result = array::literal(
+          static_cast<Type>(in.a), std::span(stack).subspan(begin));
+      stack.resize(begin);
+      stack.push_back(result);
+      break;
+    }
+    case OpCode::ALLOC_ARRAY:
+      stack.back() = array::allocate(static_cast<Type>(in.a), stack.back());
+      break;
+    case OpCode::LOAD_ELEMENT: {
+      const Value index = stack.back();
+      stack.pop_back();
+      const Value target = stack.back();
+      stack.back() = array::load(target, index);
+      array::release(static_cast<uint8_t>(in.a), target);
+      break;
+    }
+    case OpCode::STORE_ELEMENT: {
+      const Value value = stack.back();
+      stack.pop_back();
+      const Value index = stack.back();
+      stack.pop_back();
+      array::store(stack.back(), index, value);
+      stack.back() = value;
+      break;
+    }
+    case OpCode::LENGTH: {
+      const Value target = stack.back();
+      stack.back() = array::length(target);
+      array::release(static_cast<uint8_t>(in.a), target);
+      break;
+    }
+    case OpCode::REDUCE: {
+      const Value target = stack.back();
+      stack.back() = array::reduce(target, static_cast<BinOpType>(in.a));
+      array::release(static_cast<uint8_t>(in.b), target);
+      break;
+    }
+    case OpCode::HALT:
+      return;
+    }
+  }
+}
+
+} // namespace vm
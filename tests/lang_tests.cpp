@@ -0,0 +1,162 @@
+#include <exception>
+#include <format>
+#include <functional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <error.hpp>
+#include <interpreter.hpp>
+
+// regression tests run by ctest, each one a function that throws on failure
+
+namespace {
+
+struct Failure : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+void check(const bool ok, const std::string &what) {
+  if (!ok)
+    throw Failure(what);
+}
+
+void expect_output(const std::string &got, const std::string_view want) {
+  check(got == want, std::format("printed \"{}\", expected \"{}\"", got, want));
+}
+
+// the message of the Error thrown by f, empty when it returns
+std::string error_of(const std::function<void()> &f) {
+  try {
+    f();
+  } catch (const Error &e) {
+    return e.what();
+  }
+  return {};
+}
+
+void integer_literal_out_of_range() {
+  Interpreter interpreter;
+  const std::string error = error_of(
+      [&] { interpreter.load("int x = 1;\nint y = 2147483648;\n", "big.lang"); });
+  check(error == "big.lang:2:9: integer literal out of range",
+        std::format("got error \"{}\"", error));
+  interpreter.load("int z = 2147483647;\nprint(\"$z\");\n");
+  expect_output(interpreter.run(), "2147483647\n");
+}
+
+// both programs intern their template first, so the two share a handle
+void interpolation_per_program() {
+  for (const std::string engine : {"tree", "vm", "flat"}) {
+    Interpreter first({.engine = engine});
+    first.load("int a = 1;\nstring s = \"a=$a\";\nprint(s);\n");
+    expect_output(first.run(), "a=1\n");
+    Interpreter second({.engine = engine});
+    second.load("int b = 2;\nstring t = \"b=$b\";\nprint(t);\n");
+    expect_output(second.run(), "b=2\n");
+    first.load("int c = 3;\nstring u = \"c=$c\";\nprint(u);\n");
+    expect_output(first.run(), "c=3\n");
+  }
+}
+
+// both forms of a function body, loaded once and run twice
+void function_bodies() {
+  const std::string source = R"(fn add = (int x, int y) -> x + y;
+fn sub = (int x, int y) -> int { int d = x - y; d; }
+fn sq = (float v) -> float { float w = v * v; w; }
+int r = sub(10, 3);
+int s = add(add(1, 2), 3);
+float t = sq(1.5);
+print("r=$r s=$s t=$t");
+)";
+  for (const std::string engine : {"tree", "vm", "flat"}) {
+    Interpreter interpreter({.engine = engine});
+    interpreter.load(source);
+    expect_output(interpreter.run(), "r=7 s=6 t=2.25\n");
+    expect_output(interpreter.run(), "r=7 s=6 t=2.25\n");
+  }
+}
+
+// g is only found pure while f is assumed to be, f prints, so neither
+// may be memoized
+void mutual_recursion_is_impure() {
+  const std::string source = R"(fn f = (int n) -> int {
+  int r = 0;
+  int once = 1;
+  loop n {
+    loop once {
+      r = g(n - 1);
+    }
+    once = 0;
+  }
+  print("f $n");
+  r;
+}
+fn g = (int m) -> int { int s = f(m); s; }
+int a = g(1);
+int b = g(1);
+)";
+  for (const std::string engine : {"tree", "vm", "flat"}) {
+    Interpreter interpreter({.engine = engine, .memoize = true});
+    interpreter.load(source);
+    expect_output(interpreter.run(), "f 0\nf 1\nf 0\nf 1\n");
+  }
+}
+
+// peak resident memory so far, in KB
+long peak_memory() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// every iteration makes 16KB arrays, kept they would add up to 320MB
+void array_temporaries_freed() {
+  const std::string source = R"(int[] a = int[4096];
+int[] b = int[4096];
+b[0] = 1;
+fn g = (int[] x) -> int { int[] y = x * 2; y = y + 1; int r = y[0]; r; }
+int s = 0;
+loop 20000 {
+  a = a + b;
+  s = s + sum(a * 2) + g(a);
+}
+print("$s");
+)";
+  for (const std::string engine : {"tree", "vm", "flat"}) {
+    const long before = peak_memory();
+    Interpreter interpreter({.engine = engine});
+    interpreter.load(source);
+    expect_output(interpreter.run(), "800060000\n");
+    const long grown = peak_memory() - before;
+    check(grown < 32 * 1024,
+          std::format("{}: peak memory grew by {}KB", engine, grown));
+  }
+}
+
+const std::vector<std::pair<std::string_view, void (*)()>> tests = {
+    {"integer_literal_out_of_range", integer_literal_out_of_range},
+    {"interpolation_per_program", interpolation_per_program},
+    {"function_bodies", function_bodies},
+    {"mutual_recursion_is_impure", mutual_recursion_is_impure},
+    {"array_temporaries_freed", array_temporaries_freed},
+};
+
+} // namespace
+
+int main() {
+  int failed = 0;
+  for (const auto &[name, test] : tests) {
+    try {
+      test();
+      std::println("ok   {}", name);
+    } catch (const std::exception &e) {
+      std::println("FAIL {}: {}", name, e.what());
+      failed++;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}